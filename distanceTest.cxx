@@ -0,0 +1,105 @@
+#include "ioutils.h"
+#include "itkDanielssonDistanceMapImageFilter.h"
+#include "itkSeparableDistanceMapImageFilter.h"
+#include "itkChamferDistanceMapImageFilter.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+
+// compares the distance transforms that can be used by
+// SkeletonizeImageFilter: the separable one with Danielsson's, and
+// the chamfer one with the separable one, within the error of the
+// chamfer weights
+int main(int argc, char * argv[])
+{
+
+  if( argc != 2 )
+    {
+    std::cerr << "usage: " << argv[0] << " intput" << std::endl;
+    std::cerr << " input: the input image" << std::endl;
+    exit(1);
+    }
+
+  const int dim = 2;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+  typedef itk::Image< float, dim > DistType;
+  typedef itk::Image< unsigned short, dim > ChamferType;
+
+  IType::Pointer input = readIm<IType>(argv[1]);
+
+  typedef itk::BinaryThresholdImageFilter<IType, IType> ThreshType;
+  // Danielsson computes the distance to the non zero voxels
+  ThreshType::Pointer inverted = ThreshType::New();
+  inverted->SetInput(input);
+  inverted->SetUpperThreshold(130);
+  inverted->SetOutsideValue(1);
+  inverted->SetInsideValue(0);
+
+  ThreshType::Pointer thresh = ThreshType::New();
+  thresh->SetInput(input);
+  thresh->SetUpperThreshold(130);
+  thresh->SetOutsideValue(0);
+  thresh->SetInsideValue(1);
+
+  typedef itk::DanielssonDistanceMapImageFilter<IType, DistType> DTType;
+  DTType::Pointer danielsson = DTType::New();
+  danielsson->SetInput(inverted->GetOutput());
+  danielsson->SetUseImageSpacing(true);
+  danielsson->Update();
+
+  typedef itk::SeparableDistanceMapImageFilter<IType, DistType> SepType;
+  SepType::Pointer separable = SepType::New();
+  separable->SetInput(thresh->GetOutput());
+  separable->SetUseImageSpacing(true);
+  separable->Update();
+
+  typedef itk::ChamferDistanceMapImageFilter<IType, ChamferType> ChamferDTType;
+  ChamferDTType::Pointer chamfer = ChamferDTType::New();
+  chamfer->SetInput(thresh->GetOutput());
+  chamfer->SetUseImageSpacing(true);
+  chamfer->Update();
+
+  itk::ImageRegionConstIterator<DistType> dIt(danielsson->GetOutput(),
+					      danielsson->GetOutput()->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<DistType> sIt(separable->GetOutput(),
+					      separable->GetOutput()->GetLargestPossibleRegion());
+  itk::ImageRegionConstIterator<ChamferType> cIt(chamfer->GetOutput(),
+						 chamfer->GetOutput()->GetLargestPossibleRegion());
+
+  // a chamfer step of 3 is the smallest spacing. Along (x, y), x >= y,
+  // the 3-4 chamfer gives x + y / 3 steps, which is between 2 sqrt(2) / 3
+  // (the diagonal) and sqrt(10) / 3 (at y = x / 3) times the euclidean
+  // length
+  double smallest = input->GetSpacing()[0];
+  for (unsigned d = 1; d < dim; d++)
+    {
+    smallest = std::min(smallest, (double)input->GetSpacing()[d]);
+    }
+  const double lowest = 2.0 * sqrt(2.0) / 3.0 - 1e-4;
+  const double highest = sqrt(10.0) / 3.0 + 1e-4;
+
+  // Danielsson's propagation isn't exact, so allow a small difference
+  float worst = 0;
+  unsigned long chamferErrors = 0;
+  for (; !dIt.IsAtEnd(); ++dIt, ++sIt, ++cIt)
+    {
+    worst = std::max(worst, (float)fabs(dIt.Get() - sIt.Get()));
+    const double euclidean = sIt.Get();
+    const double scaled = cIt.Get() * smallest / 3.0;
+    if ((euclidean == 0) != (scaled == 0) ||
+	scaled < lowest * euclidean || scaled > highest * euclidean)
+      {
+      ++chamferErrors;
+      }
+    }
+  std::cout << "Largest difference with Danielsson: " << worst << std::endl;
+  std::cout << "Chamfer distances out of bounds: " << chamferErrors << std::endl;
+  if (worst > 1.0 || chamferErrors > 0)
+    {
+    std::cerr << "Distance transforms differ" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
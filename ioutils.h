@@ -7,6 +7,18 @@
 #include <itkStatisticsImageFilter.h>
 #include <itkNumericTraits.h>
 #include <itkOrientImageFilter.h>
+#include <itkImportImageContainer.h>
+#include <itkByteSwapper.h>
+#include <fstream>
+#include <typeinfo>
+#include <cctype>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define IOUTILS_USE_MMAP
+#endif
 
 
 int readImageInfo(std::string filename, itk::ImageIOBase::IOComponentType *ComponentType)
@@ -114,4 +126,238 @@ typename TImage::Pointer readImOrient(std::string filename)
   return(result);
 }
 
+// memory mapped images. The raw data of uncompressed MetaImage (.mha,
+// .mhd) and NRRD (.nrrd, .nhdr) files becomes the buffer of the
+// image, so nothing is read or copied up front and the pages are
+// shared with the file cache.
+
+// where the raw data of an uncompressed MetaImage or NRRD file is: the
+// file holding it and the offset of its first byte. dataBytes is the
+// size of the data, for the headers that put it at the end of the
+// file. Returns false for other formats, compressed or encoded data
+// and files that are too short.
+inline bool rawDataLocation(std::string filename, unsigned long dataBytes,
+			    std::string &dataFile, unsigned long &offset)
+{
+  const std::string::size_type dot = filename.rfind('.');
+  if (dot == std::string::npos) return false;
+  std::string ext = filename.substr(dot + 1);
+  for (unsigned i = 0; i < ext.size(); i++) ext[i] = tolower(ext[i]);
+  const bool meta = (ext == "mha" || ext == "mhd");
+  const bool nrrd = (ext == "nrrd" || ext == "nhdr");
+  if (!meta && !nrrd) return false;
+
+  // detached data files are relative to the header
+  const std::string::size_type slash = filename.rfind('/');
+  const std::string dir = (slash == std::string::npos) ? "" : filename.substr(0, slash + 1);
+
+  std::ifstream header(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!header) return false;
+
+  long skip = 0;   // HeaderSize or byte skip, -1 for the end of the file
+  bool found = false;
+  std::string line;
+  if (nrrd && !(std::getline(header, line) && line.compare(0, 4, "NRRD") == 0)) return false;
+  while (std::getline(header, line))
+    {
+    if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+    if (nrrd && line.empty())
+      {
+      // the end of the header, and the start of attached data
+      if (!found)
+	{
+	dataFile = filename;
+	offset = header.tellg();
+	found = true;
+	}
+      break;
+      }
+    if (nrrd && (line[0] == '#' || line.find(":=") != std::string::npos)) continue;
+
+    const std::string::size_type sep = line.find(meta ? '=' : ':');
+    if (sep == std::string::npos) continue;
+    std::string key = line.substr(0, sep);
+    std::string value = line.substr(sep + 1);
+    key.erase(key.find_last_not_of(" \t") + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t") + 1);
+
+    if (meta)
+      {
+      if (key == "CompressedData" && value != "False") return false;
+      if (key == "HeaderSize") skip = atol(value.c_str());
+      if (key == "ElementDataFile")
+	{
+	// the data follows this line, the last one of the header
+	if (value == "LOCAL")
+	  {
+	  dataFile = filename;
+	  offset = header.tellg();
+	  skip = 0;
+	  }
+	else
+	  {
+	  // lists of slice files can't be mapped as one buffer
+	  if (value.empty() || value.compare(0, 4, "LIST") == 0 || value.find(' ') != std::string::npos) return false;
+	  dataFile = (value[0] == '/') ? value : dir + value;
+	  offset = 0;
+	  }
+	found = true;
+	break;
+	}
+      }
+    else
+      {
+      if (key == "encoding" && value != "raw") return false;
+      if ((key == "line skip" || key == "lineskip") && atol(value.c_str()) != 0) return false;
+      if (key == "byte skip" || key == "byteskip") skip = atol(value.c_str());
+      if (key == "data file" || key == "datafile")
+	{
+	if (value.empty() || value.find(' ') != std::string::npos || value.compare(0, 4, "LIST") == 0) return false;
+	dataFile = (value[0] == '/') ? value : dir + value;
+	offset = 0;
+	found = true;
+	}
+      }
+    }
+  if (!found) return false;
+
+  std::ifstream data(dataFile.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  if (!data) return false;
+  const unsigned long fileSize = data.tellg();
+  if (skip == -1)
+    {
+    if (fileSize < dataBytes) return false;
+    offset = fileSize - dataBytes;
+    }
+  else
+    {
+    offset += skip;
+    }
+  return offset + dataBytes <= fileSize;
+}
+
+#ifdef IOUTILS_USE_MMAP
+// pixel container of a mapped image, unmapping the file when the
+// image is released
+template <class TImage>
+class MappedPixelContainer : public TImage::PixelContainer
+{
+public:
+  typedef MappedPixelContainer Self;
+  typedef typename TImage::PixelContainer Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+  itkNewMacro(Self);
+
+  // the pixels start at offset in the mapping. The container never
+  // frees them itself
+  void SetMapping(void *mapping, unsigned long length, unsigned long offset,
+		  unsigned long pixels)
+    {
+    m_Mapping = mapping;
+    m_MappingLength = length;
+    this->SetImportPointer(reinterpret_cast<typename TImage::PixelType *>(
+			     static_cast<char *>(mapping) + offset), pixels, false);
+    }
+
+protected:
+  MappedPixelContainer() : m_Mapping(0), m_MappingLength(0) {}
+  ~MappedPixelContainer()
+    {
+    if (m_Mapping) munmap(m_Mapping, m_MappingLength);
+    }
+
+private:
+  MappedPixelContainer(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+  void *m_Mapping;
+  unsigned long m_MappingLength;
+};
+#endif
+
+// reads an image whose file holds the pixels as TImage does
+// (uncompressed MetaImage or NRRD, same pixel type and byte order) by
+// mapping it instead of copying it. The mapping is private: writing
+// to the image never changes the file. Other files are read with
+// readIm.
+template <class TImage>
+typename TImage::Pointer mapIm(std::string filename)
+{
+#ifdef IOUTILS_USE_MMAP
+  typedef typename TImage::PixelType PixelType;
+  const unsigned dim = TImage::ImageDimension;
+
+  itk::ImageIOBase::Pointer imageIO = itk::ImageIOFactory::CreateImageIO(filename.c_str(), itk::ImageIOFactory::ReadMode);
+  if (imageIO.IsNull())
+    return readIm<TImage>(filename);
+  imageIO->SetFileName(filename.c_str());
+  try
+    {
+    imageIO->ReadImageInformation();
+    }
+  catch(itk::ExceptionObject &)
+    {
+    return readIm<TImage>(filename);
+    }
+
+  const itk::ImageIOBase::ByteOrder systemOrder = itk::ByteSwapper<int>::SystemIsBigEndian() ?
+    itk::ImageIOBase::BigEndian : itk::ImageIOBase::LittleEndian;
+  if (imageIO->GetNumberOfDimensions() != dim
+      || imageIO->GetNumberOfComponents() != 1
+      || imageIO->GetComponentTypeInfo() != typeid(PixelType)
+      || (sizeof(PixelType) > 1 && imageIO->GetByteOrder() != systemOrder))
+    return readIm<TImage>(filename);
+
+  typename TImage::RegionType region;
+  typename TImage::SpacingType spacing;
+  typename TImage::PointType origin;
+  typename TImage::DirectionType direction;
+  unsigned long pixels = 1;
+  for (unsigned d = 0; d < dim; d++)
+    {
+    region.SetIndex(d, 0);
+    region.SetSize(d, imageIO->GetDimensions(d));
+    spacing[d] = imageIO->GetSpacing(d);
+    origin[d] = imageIO->GetOrigin(d);
+    for (unsigned i = 0; i < dim; i++)
+      {
+      direction[i][d] = imageIO->GetDirection(d)[i];
+      }
+    pixels *= region.GetSize()[d];
+    }
+
+  // the pixels must be aligned in the mapping, which starts on a page
+  std::string dataFile;
+  unsigned long offset;
+  const unsigned long dataBytes = pixels * sizeof(PixelType);
+  if (pixels == 0
+      || !rawDataLocation(filename, dataBytes, dataFile, offset)
+      || offset % sizeof(PixelType) != 0)
+    return readIm<TImage>(filename);
+
+  const int fd = open(dataFile.c_str(), O_RDONLY);
+  if (fd < 0)
+    return readIm<TImage>(filename);
+  const unsigned long length = offset + dataBytes;
+  void *mapping = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return readIm<TImage>(filename);
+
+  typename MappedPixelContainer<TImage>::Pointer container = MappedPixelContainer<TImage>::New();
+  container->SetMapping(mapping, length, offset, pixels);
+
+  typename TImage::Pointer result = TImage::New();
+  result->SetRegions(region);
+  result->SetSpacing(spacing);
+  result->SetOrigin(origin);
+  result->SetDirection(direction);
+  result->SetPixelContainer(container);
+  return(result);
+#else
+  return readIm<TImage>(filename);
+#endif
+}
+
 #endif
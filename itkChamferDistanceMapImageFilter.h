@@ -0,0 +1,81 @@
+#ifndef __itkChamferDistanceMapImageFilter_h
+#define __itkChamferDistanceMapImageFilter_h
+
+#include "itkImageToImageFilter.h"
+
+namespace itk
+{
+/** \class ChamferDistanceMapImageFilter
+ *
+ * \brief Integer chamfer approximation of the distance map
+ *
+ * Each non zero voxel of the input gets the length of the shortest
+ * path to a zero voxel, the steps between neighbors having integer
+ * weights proportional to their length: 3 for the shortest step and
+ * 4 and 5 for the diagonals of an isotropic image (see
+ * ChamferWeights). Voxels outside the image are not considered to be
+ * zero, and the distances saturate at the maximum of the output pixel
+ * type.
+ *
+ * The map is computed in place in the output by two raster scans,
+ * so it is much cheaper than the euclidean transforms, and an output
+ * of small integers makes a cheap ordering image for
+ * SkeletonizeBaseImageFilter. The output pixel type must be an
+ * unsigned integer type.
+ *
+ * \author Richard Beare
+ */
+template <class TInputImage, class TOutputImage>
+class ITK_EXPORT ChamferDistanceMapImageFilter :
+    public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef ChamferDistanceMapImageFilter Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage> Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ChamferDistanceMapImageFilter, ImageToImageFilter);
+
+  typedef TInputImage InputImageType;
+  typedef TOutputImage OutputImageType;
+  typedef typename InputImageType::PixelType InputPixelType;
+  typedef typename OutputImageType::PixelType OutputPixelType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int,
+                      TInputImage::ImageDimension);
+
+  /** Set/Get whether the weights follow the image spacing. Defaults
+   * to true */
+  itkSetMacro(UseImageSpacing, bool);
+  itkGetConstReferenceMacro(UseImageSpacing, bool);
+  itkBooleanMacro(UseImageSpacing);
+
+protected:
+  ChamferDistanceMapImageFilter();
+  virtual ~ChamferDistanceMapImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  void GenerateInputRequestedRegion();
+  void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
+  void GenerateData();
+
+private:
+  ChamferDistanceMapImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  bool m_UseImageSpacing;
+};
+
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkChamferDistanceMapImageFilter.txx"
+#endif
+
+#endif
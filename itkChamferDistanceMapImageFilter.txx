@@ -0,0 +1,90 @@
+#ifndef __itkChamferDistanceMapImageFilter_txx
+#define __itkChamferDistanceMapImageFilter_txx
+
+#include "itkChamferDistanceMapImageFilter.h"
+#include "itkDistanceMapKernels.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+
+namespace itk
+{
+
+template <class TInputImage, class TOutputImage>
+ChamferDistanceMapImageFilter<TInputImage, TOutputImage>
+::ChamferDistanceMapImageFilter()
+{
+  m_UseImageSpacing = true;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+ChamferDistanceMapImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+
+  // We need all the input.
+  InputImageType * input = const_cast<InputImageType *>(this->GetInput());
+  if ( !input )
+    { return; }
+  input->SetRequestedRegion( input->GetLargestPossibleRegion() );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+ChamferDistanceMapImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *)
+{
+  this->GetOutput()
+    ->SetRequestedRegion( this->GetOutput()->GetLargestPossibleRegion() );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+ChamferDistanceMapImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  this->AllocateOutputs();
+  const InputImageType * input = this->GetInput();
+  OutputImageType * output = this->GetOutput();
+  const typename OutputImageType::RegionType region = output->GetRequestedRegion();
+
+  // zero on the background, unknown elsewhere
+  ImageRegionConstIterator<InputImageType> It(input, region);
+  ImageRegionIterator<OutputImageType> Ot(output, region);
+  for (; !It.IsAtEnd(); ++It, ++Ot)
+    {
+    Ot.Set((It.Get() != NumericTraits<InputPixelType>::Zero) ?
+	   NumericTraits<OutputPixelType>::max() :
+	   NumericTraits<OutputPixelType>::Zero);
+    }
+  this->UpdateProgress(0.2);
+
+  unsigned long size[ImageDimension];
+  long strides[ImageDimension];
+  double spacing[ImageDimension];
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    size[d] = region.GetSize()[d];
+    strides[d] = output->GetOffsetTable()[d];
+    spacing[d] = m_UseImageSpacing ? input->GetSpacing()[d] : 1.0;
+    }
+  ChamferDistanceMap(output->GetBufferPointer() + output->ComputeOffset(region.GetIndex()),
+		     ImageDimension, size, strides,
+		     ChamferWeights(ImageDimension, spacing));
+  this->UpdateProgress(1.0);
+}
+
+template <class TInputImage, class TOutputImage>
+void
+ChamferDistanceMapImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "UseImageSpacing: " << m_UseImageSpacing << std::endl;
+}
+
+} // end namespace itk
+
+#endif
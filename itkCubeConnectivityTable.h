@@ -0,0 +1,143 @@
+#ifndef __itkCubeConnectivityTable_h
+#define __itkCubeConnectivityTable_h
+
+#include <itkOffset.h>
+
+namespace itk
+{
+
+/** number of positions of the 3x3... cube in VDimension dimensions */
+template <unsigned int VDimension>
+struct CubePositions
+{
+  enum { Value = 3 * CubePositions<VDimension - 1>::Value };
+};
+
+template <>
+struct CubePositions<0>
+{
+  enum { Value = 1 };
+};
+
+/** \class CubeConnectivityTable
+ * \brief Adjacency of the positions of the cube around a voxel under
+ * a cell connectivity, in fixed size arrays.
+ *
+ * Positions are numbered like the offsets of itk::Neighborhood with
+ * radius 1, the first dimension varying fastest, so the centre is
+ * Size / 2. Two positions are adjacent when they differ by at most
+ * one in each dimension and agree in at least CellConnectivity of
+ * them, as in setCellConnectivity. The neighbours of a position that
+ * fall outside the cube aren't listed.
+ *
+ * The tables are computed from the position numbers alone, so setting
+ * them up costs no allocation, and the sizes are known at compile
+ * time for the connected component counts of
+ * SkeletonizeBaseImageFilter.
+ *
+ * \author Richard Beare
+ */
+template <unsigned int VDimension>
+class CubeConnectivityTable
+{
+public:
+  enum { Size = CubePositions<VDimension>::Value };
+  enum { Centre = Size / 2 };
+
+  /** positions fit in a short up to 10 dimensions */
+  typedef unsigned short PositionType;
+  typedef Offset<VDimension> OffsetType;
+
+  CubeConnectivityTable()
+    {
+    Initialize(0, 0);
+    }
+
+  /** cellConnectivity gives the adjacency of the positions and
+   * neighborhoodConnectivity the positions around the centre whose
+   * neighbours are followed by the component counts */
+  void Initialize(unsigned cellConnectivity, unsigned neighborhoodConnectivity)
+    {
+    for (unsigned a = 0; a < Size; a++)
+      {
+      m_NumberOfNeighbors[a] = 0;
+      for (unsigned b = 0; b < Size; b++)
+	{
+	if (IsAdjacent(a, b, cellConnectivity))
+	  {
+	  m_Neighbors[a][m_NumberOfNeighbors[a]++] = b;
+	  }
+	}
+      m_ConnectivityTest[a] = IsAdjacent(Centre, a, cellConnectivity);
+      m_NeighConnectivityTest[a] = IsAdjacent(Centre, a, neighborhoodConnectivity);
+      }
+    }
+
+  unsigned GetNumberOfNeighbors(unsigned pos) const
+    {
+    return m_NumberOfNeighbors[pos];
+    }
+
+  /** the neighbours of pos, in increasing order */
+  const PositionType * GetNeighbors(unsigned pos) const
+    {
+    return m_Neighbors[pos];
+    }
+
+  /** whether pos is adjacent to the centre */
+  bool GetConnectivityTest(unsigned pos) const
+    {
+    return m_ConnectivityTest[pos];
+    }
+
+  /** whether pos is adjacent to the centre under the neighborhood
+   * connectivity */
+  bool GetNeighConnectivityTest(unsigned pos) const
+    {
+    return m_NeighConnectivityTest[pos];
+    }
+
+  /** offset of a position from the centre */
+  static OffsetType GetOffset(unsigned pos)
+    {
+    OffsetType offset;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      offset[d] = (long)(pos % 3) - 1;
+      pos /= 3;
+      }
+    return offset;
+    }
+
+  /** whether two positions are adjacent under a cell connectivity */
+  static bool IsAdjacent(unsigned a, unsigned b, unsigned cellConnectivity)
+    {
+    if (a == b)
+      {
+      return false;
+      }
+    unsigned zeros = 0;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      const int delta = (int)(a % 3) - (int)(b % 3);
+      if (delta < -1 || delta > 1)
+	{
+	return false;
+	}
+      zeros += (delta == 0);
+      a /= 3;
+      b /= 3;
+      }
+    return zeros >= cellConnectivity;
+    }
+
+private:
+  PositionType m_Neighbors[Size][Size - 1];
+  unsigned m_NumberOfNeighbors[Size];
+  bool m_ConnectivityTest[Size];
+  bool m_NeighConnectivityTest[Size];
+};
+
+} // end namespace itk
+
+#endif
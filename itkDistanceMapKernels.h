@@ -0,0 +1,212 @@
+#ifndef __itkDistanceMapKernels_h
+#define __itkDistanceMapKernels_h
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <itkNumericTraits.h>
+
+namespace itk
+{
+
+/** Exact squared euclidean distance along a line, by the lower
+ * envelope of parabolas (Felzenszwalb & Huttenlocher, the 1D step of
+ * Maurer's separable transform).
+ *
+ * f holds the squared distances already computed along the other
+ * dimensions (0 at the background, NumericTraits<TReal>::max() where
+ * no background has been found), spacing is the distance between the
+ * voxels of the line and d gets the result - it can't be f. v and z
+ * are work space of n and n + 1 elements. Running it over the lines
+ * of each dimension in turn gives the squared distance map.
+ */
+template <class TReal>
+void SquaredDistanceLine(const TReal *f, unsigned long n, TReal spacing,
+			 TReal *d, unsigned long *v, TReal *z)
+{
+  const TReal infinity = NumericTraits<TReal>::max();
+
+  // parabolas of the lower envelope, skipping the samples without
+  // background
+  long k = -1;
+  for (unsigned long q = 0; q < n; q++)
+    {
+    if (f[q] == infinity) continue;
+    const TReal pq = q * spacing;
+    if (k < 0)
+      {
+      k = 0;
+      v[0] = q;
+      z[0] = -infinity;
+      z[1] = infinity;
+      continue;
+      }
+    TReal s;
+    for (;;)
+      {
+      const TReal pv = v[k] * spacing;
+      // where the parabolas from v[k] and q intersect
+      s = ((f[q] + pq * pq) - (f[v[k]] + pv * pv)) / (2 * (pq - pv));
+      if (s > z[k]) break;
+      // z[0] is -infinity, so k never gets below 0
+      --k;
+      }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = infinity;
+    }
+
+  if (k < 0)
+    {
+    // no background in the line or in the lines that lead to it
+    std::fill(d, d + n, infinity);
+    return;
+    }
+
+  long j = 0;
+  for (unsigned long q = 0; q < n; q++)
+    {
+    const TReal pq = q * spacing;
+    while (z[j + 1] < pq)
+      {
+      ++j;
+      }
+    const TReal delta = pq - v[j] * spacing;
+    d[q] = delta * delta + f[v[j]];
+    }
+}
+
+/** Chamfer distance map computed in place, in two raster scans.
+ *
+ * buffer holds an image of the given dimension, size and strides,
+ * with 0 at the background and NumericTraits<TPixel>::max() on the
+ * foreground. On return each foreground voxel holds the chamfer
+ * distance to the background, the step to each of the 3^dim - 1
+ * neighbors costing weights[neighbor] (neighbors in
+ * itk::Neighborhood order, centre excluded). The sums saturate at
+ * max(), and voxels outside the image are not background.
+ */
+template <class TPixel>
+void ChamferDistanceMap(TPixel *buffer, unsigned dim,
+			const unsigned long *size, const long *strides,
+			const std::vector<unsigned long> &weights)
+{
+  const unsigned long infinity = NumericTraits<TPixel>::max();
+
+  // the neighbors before the centre in raster order are used by the
+  // forward scan, the ones after by the backward scan
+  unsigned cubeSize = 1;
+  for (unsigned d = 0; d < dim; d++)
+    {
+    cubeSize *= 3;
+    }
+  const unsigned half = cubeSize / 2;
+  std::vector<long> offsets(cubeSize);
+  std::vector<long> deltas(cubeSize * dim);
+  for (unsigned pos = 0; pos < cubeSize; pos++)
+    {
+    unsigned rest = pos;
+    offsets[pos] = 0;
+    for (unsigned d = 0; d < dim; d++)
+      {
+      deltas[pos * dim + d] = (long)(rest % 3) - 1;
+      offsets[pos] += deltas[pos * dim + d] * strides[d];
+      rest /= 3;
+      }
+    }
+
+  unsigned long total = 1;
+  for (unsigned d = 0; d < dim; d++)
+    {
+    total *= size[d];
+    }
+  if (total == 0) return;
+
+  std::vector<long> position(dim);
+  for (int pass = 0; pass < 2; pass++)
+    {
+    const bool forward = (pass == 0);
+    const unsigned first = forward ? 0 : half + 1;
+    const unsigned last = forward ? half : cubeSize;
+    for (unsigned d = 0; d < dim; d++)
+      {
+      position[d] = forward ? 0 : size[d] - 1;
+      }
+    for (unsigned long i = 0; i < total; i++)
+      {
+      long off = 0;
+      for (unsigned d = 0; d < dim; d++)
+	{
+	off += position[d] * strides[d];
+	}
+      TPixel &value = buffer[off];
+      if (value != 0)
+	{
+	unsigned long best = value;
+	for (unsigned k = first; k < last; k++)
+	  {
+	  bool inside = true;
+	  for (unsigned d = 0; d < dim && inside; d++)
+	    {
+	    const long p = position[d] + deltas[k * dim + d];
+	    inside = (p >= 0) && (p < (long)size[d]);
+	    }
+	  if (!inside) continue;
+	  const unsigned long n = buffer[off + offsets[k]];
+	  if (n == infinity) continue;
+	  best = std::min(best, std::min(n + weights[k < half ? k : k - 1], infinity));
+	  }
+	value = static_cast<TPixel>(best);
+	}
+
+      // next voxel in raster order, forward or backward
+      for (unsigned d = 0; d < dim; d++)
+	{
+	if (forward)
+	  {
+	  if (++position[d] < (long)size[d]) break;
+	  position[d] = 0;
+	  }
+	else
+	  {
+	  if (--position[d] >= 0) break;
+	  position[d] = size[d] - 1;
+	  }
+	}
+      }
+    }
+}
+
+/** integer chamfer weights for the 3^dim - 1 neighbors, proportional
+ * to the physical length of the steps: 3 for the shortest step, and
+ * 4 and 5 for the diagonals of isotropic images */
+inline std::vector<unsigned long> ChamferWeights(unsigned dim, const double *spacing)
+{
+  unsigned cubeSize = 1;
+  double smallest = spacing[0];
+  for (unsigned d = 0; d < dim; d++)
+    {
+    cubeSize *= 3;
+    smallest = std::min(smallest, spacing[d]);
+    }
+  std::vector<unsigned long> weights;
+  for (unsigned pos = 0; pos < cubeSize; pos++)
+    {
+    if (pos == cubeSize / 2) continue;
+    unsigned rest = pos;
+    double length2 = 0;
+    for (unsigned d = 0; d < dim; d++)
+      {
+      const double delta = ((double)(rest % 3) - 1) * spacing[d];
+      length2 += delta * delta;
+      rest /= 3;
+      }
+    weights.push_back((unsigned long)(3 * std::sqrt(length2) / smallest + 0.5));
+    }
+  return weights;
+}
+
+} // end namespace itk
+
+#endif
@@ -5,6 +5,8 @@
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkNeighborhoodIterator.h>
 #include <itkProgressReporter.h>
+#include <itkMultiThreader.h>
+#include "itkNeighborCountKernels.h"
 namespace itk
 {
 /** \class FastBinaryPruningImageFilter
@@ -20,6 +22,19 @@ namespace itk
  * This version of the filter is more efficient, extendable to
  * arbitary dimensions and has the novel benefit of producing correct
  * answers.
+ *
+ * The first erosion tests every skeleton voxel. A voxel can only
+ * become an endpoint when one of its neighbors is removed, so each
+ * following erosion only tests the neighbors of the voxels removed by
+ * the previous one, and the cost follows the number of removed voxels
+ * rather than the size of the skeleton. The pruning stops early when
+ * an erosion removes nothing.
+ *
+ * Each erosion tests its voxels against the image left by the
+ * previous one, so the voxels are split between the threads (see
+ * SetNumberOfThreads) and the endpoints are removed once all the
+ * threads are done. The result doesn't depend on the number of
+ * threads.
  * 
  * Rafael C. Gonzales and Richard E. Woods. 
  * Digital Image Processing. 
@@ -128,7 +143,27 @@ protected:
   /** Compute thinning Image. */
   void GenerateData();
 
-  void doErode(typename TOutputImage::Pointer &t1, IndexVec &v1, IndexVec &v2, ProgressReporter *progress);
+  // test the candidates, remove the endpoints and put their
+  // neighbors, once, in next. queued flags the voxels of next
+  void doErode(typename TOutputImage::Pointer &t1, IndexVec &candidates, IndexVec &next,
+	       std::vector<bool> &queued, ProgressReporter *progress);
+
+  // test the voxels [first, last) of a pass, appending the endpoints
+  // to deleted
+  void erodeRange(typename IndexVec::const_iterator first,
+		  typename IndexVec::const_iterator last,
+		  IndexVec &deleted) const;
+
+  // data shared by the threads of a pass
+  struct ErodeThreadStruct
+  {
+    const Self * Filter;
+    const IndexVec * Voxels;
+    std::vector<IndexVec> Deleted;
+  };
+  static ITK_THREAD_RETURN_TYPE ErodeThreaderCallback(void *arg);
+
+  typedef NeighborCountKernel<itkGetStaticConstMacro(OutputImageDimension)> KernelType;
 private:   
   FastBinaryPruningImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
@@ -136,6 +171,12 @@ private:
 	unsigned m_ForegroundCellConnectivity;
   unsigned int                  m_Iteration;
 
+  // the foreground of the output as padded bytes, kept in step with
+  // the output, for counting the neighbours
+  KernelType m_Kernel;
+  std::vector<unsigned char> m_Buffer;
+  IndexType m_RegionIndex;
+
 }; // end of BinaryThinningImageFilter class
 
 } //end namespace itk
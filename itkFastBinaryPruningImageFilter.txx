@@ -6,12 +6,8 @@
 #include "itkFastBinaryPruningImageFilter.h"
 #include "itkImageRegionConstIterator.h"
 #include "itkImageRegionIterator.h"
-#include "itkNeighborhoodIterator.h"
-#include "itkShapedNeighborhoodIterator.h"
-#include "itkConstShapedNeighborhoodIterator.h"
-#include "itkSkeletonConnectivity.h"
 #include "itkSize.h"
-#include "itkConstantBoundaryCondition.h"
+#include <algorithm>
 
 
 namespace itk
@@ -64,58 +60,125 @@ FastBinaryPruningImageFilter<TInputImage,TOutputImage>
 template <class TInputImage,class TOutputImage>
 void 
 FastBinaryPruningImageFilter<TInputImage,TOutputImage>
-::doErode(typename TOutputImage::Pointer &t1, IndexVec &v1, IndexVec &v2, ProgressReporter *progress) 
+::erodeRange(typename IndexVec::const_iterator first,
+	     typename IndexVec::const_iterator last,
+	     IndexVec &deleted) const
 {
   // in this version we iterate over the voxels known to be members of
   // the skeleton.
-  typedef ConstShapedNeighborhoodIterator<OutputImageType> ShapedNeighborhoodIteratorType;
-  typename ShapedNeighborhoodIteratorType::RadiusType radius;
-  radius.Fill(1);
-  typename OutputImageType::RegionType region  = this->GetOutput()->GetRequestedRegion();
-
-  ShapedNeighborhoodIteratorType it(radius, t1, region);
-  IndexVec deletedPoints;
-
-  ConstantBoundaryCondition<OutputImageType> bc;
-  bc.SetConstant(0);
-  it.OverrideBoundaryCondition(&bc);
-  setCellConnectivity( &it, m_ForegroundCellConnectivity );
-
-  typename ShapedNeighborhoodIteratorType::ConstIterator nIt;
-
-  it.GoToBegin();
+  const IndexType start = m_RegionIndex;
+  const unsigned char *buffer = &m_Buffer[0];
 
   typedef typename IndexVec::const_iterator vecItType;
-  for (vecItType vecIt = v1.begin(); vecIt != v1.end(); vecIt++)
+  for (vecItType vecIt = first; vecIt != last; vecIt++)
     {
     // get the index
     IndexType Ind = *vecIt;
-    // move the iterators to this index
-    it += Ind - it.GetIndex();
-    OutputPixelType V = it.GetCenterPixel();
-
-    int genus = 0;
-    for (nIt = it.Begin(); nIt != it.End(); nIt++)
-      {
-      genus += (int)(nIt.Get() != 0);
-      }
+    const unsigned genus = m_Kernel.CountVoxel(buffer, m_Kernel.ComputeOffset(Ind - start));
     if (genus < 2)
       {
       // this point is being removed
-       deletedPoints.push_back(Ind);
+      deleted.push_back(Ind);
       }
-    else
+    }
+}
+
+template <class TInputImage,class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+FastBinaryPruningImageFilter<TInputImage,TOutputImage>
+::ErodeThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+    static_cast<MultiThreader::ThreadInfoStruct *>(arg);
+  ErodeThreadStruct * str = static_cast<ErodeThreadStruct *>(info->UserData);
+  const unsigned threadId = info->ThreadID;
+  const unsigned long total = str->Voxels->size();
+  // a contiguous share of the voxels, so that merging the deleted
+  // voxels in thread order keeps the serial order
+  const unsigned long first = total * threadId / info->NumberOfThreads;
+  const unsigned long last = total * (threadId + 1) / info->NumberOfThreads;
+  str->Filter->erodeRange(str->Voxels->begin() + first, str->Voxels->begin() + last,
+			  str->Deleted[threadId]);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage,class TOutputImage>
+void 
+FastBinaryPruningImageFilter<TInputImage,TOutputImage>
+::doErode(typename TOutputImage::Pointer &t1, IndexVec &candidates, IndexVec &next,
+	  std::vector<bool> &queued, ProgressReporter *progress) 
+{
+  // all the candidates are tested against the image left by the
+  // previous pass, so they can be shared by the threads. Small passes
+  // aren't worth starting them.
+  const unsigned long minimumVoxelsPerThread = 1024;
+  unsigned threads = this->GetNumberOfThreads();
+  if (threads > candidates.size() / minimumVoxelsPerThread)
+    {
+    threads = std::max(1UL, (unsigned long)candidates.size() / minimumVoxelsPerThread);
+    }
+
+  IndexVec deletedPoints;
+  if (threads <= 1)
+    {
+    erodeRange(candidates.begin(), candidates.end(), deletedPoints);
+    }
+  else
+    {
+    ErodeThreadStruct str;
+    str.Filter = this;
+    str.Voxels = &candidates;
+    str.Deleted.resize(threads);
+    this->GetMultiThreader()->SetNumberOfThreads(threads);
+    this->GetMultiThreader()->SetSingleMethod(ErodeThreaderCallback, &str);
+    this->GetMultiThreader()->SingleMethodExecute();
+    // the shares follow the number of threads actually started, which
+    // can be lower than asked - the last vectors are then empty
+    for (unsigned t = 0; t < threads; t++)
       {
-      // this point is being retained. Copy the index to the index buffer
-      v2.push_back(Ind);
+      deletedPoints.insert(deletedPoints.end(), str.Deleted[t].begin(), str.Deleted[t].end());
       }
+    }
+  for (unsigned long i = 0; i < candidates.size(); i++)
+    {
     progress->CompletedPixel();
     }
+
   // now we need to remove the endpoints from the input
+  const IndexType start = m_RegionIndex;
+  typedef typename IndexVec::const_iterator vecItType;
   for (vecItType vecIt = deletedPoints.begin(); vecIt != deletedPoints.end();
        vecIt++)
     {
     t1->SetPixel(*vecIt, 0);
+    m_Buffer[m_Kernel.ComputeOffset(*vecIt - start)] = 0;
+    }
+
+  // only the remaining neighbors of the removed points can become
+  // endpoints
+  const std::vector<long> &shifts = m_Kernel.GetShifts();
+  const std::vector<typename KernelType::OffsetType> &offsets = m_Kernel.GetNeighborOffsets();
+  for (vecItType vecIt = deletedPoints.begin(); vecIt != deletedPoints.end();
+       vecIt++)
+    {
+    const unsigned long centre = m_Kernel.ComputeOffset(*vecIt - start);
+    for (unsigned k = 0; k < shifts.size(); k++)
+      {
+      if (m_Buffer[centre + shifts[k]])
+	{
+	IndexType N = *vecIt + offsets[k];
+	unsigned long off = t1->ComputeOffset(N);
+	if (!queued[off])
+	  {
+	  queued[off] = true;
+	  next.push_back(N);
+	  }
+	}
+      }
+    }
+  for (vecItType vecIt = next.begin(); vecIt != next.end(); vecIt++)
+    {
+    queued[t1->ComputeOffset(*vecIt)] = false;
     }
 }
 /**
@@ -131,10 +194,17 @@ FastBinaryPruningImageFilter<TInputImage,TOutputImage>
   OutputImagePointer outputImage = this->GetOutput();
   typename OutputImageType::RegionType region  = this->GetOutput()->GetRequestedRegion();
   
-  ProgressReporter progress(this, 0, region.GetNumberOfPixels()*2);
+  // the copy is the first half of the progress, the passes share the
+  // second one
+  ProgressReporter progress(this, 0, region.GetNumberOfPixels(), 100, 0.0f, 0.5f);
 
   IndexVec v1, v2;
 
+  // the copy also fills the byte buffer of the foreground
+  m_RegionIndex = region.GetIndex();
+  m_Kernel.Initialize(region.GetSize(), m_ForegroundCellConnectivity);
+  m_Buffer.assign(m_Kernel.GetBufferSize(), 0);
+
   ImageRegionConstIterator< TInputImage >  it( inputImage,  region );
   ImageRegionIterator< TOutputImage > ot( outputImage,  region );
   
@@ -150,19 +220,29 @@ FastBinaryPruningImageFilter<TInputImage,TOutputImage>
       {
       IndexType here = ot.GetIndex();
       v1.push_back(here);
+      m_Buffer[m_Kernel.ComputeOffset(here - m_RegionIndex)] = 1;
       }
     ++it;
     ++ot;
     progress.CompletedPixel();
     }
   
-  // perform erosions
-  for (unsigned i = 0; i < m_Iteration; i++)
+  // perform erosions, the first one on the whole skeleton and the
+  // others on the neighbors of the removed voxels
+  std::vector<bool> queued(region.GetNumberOfPixels(), false);
+  for (unsigned i = 0; i < m_Iteration && !v1.empty(); i++)
     {
-    doErode(outputImage, v1, v2, &progress);
+    // a pass reports the candidates it tests, which are fewer in the
+    // later passes
+    ProgressReporter passProgress(this, 0, v1.size(), 100,
+				  0.5f + 0.5f * i / m_Iteration, 0.5f / m_Iteration);
+    doErode(outputImage, v1, v2, queued, &passProgress);
     std::swap(v1, v2);
     v2.clear();
     }
+  std::vector<unsigned char>().swap(m_Buffer);
+  // the passes may have stopped early
+  this->UpdateProgress(1.0f);
 } // end GenerateData()
 
 /**
@@ -17,17 +17,196 @@
 #ifndef __itkHierarchicalQueue_h
 #define __itkHierarchicalQueue_h
 
-// #include <vector>
+#include <vector>
 #include <list>
 #include <map>
+#include <algorithm>
+#include <cassert>
+#include "itkNumericTraits.h"
 
 namespace itk
 {
+/** \class HierarchicalQueueChunkPool
+ *  \brief Fixed size chunks of values, recycled through a free list
+ *
+ * Chunks are allocated in blocks and never returned to the system
+ * before the pool is destroyed, so a queue that has reached its peak
+ * size makes no more allocator calls.
+ */
+template <typename TValue>
+class HierarchicalQueueChunkPool
+{
+public:
+  itkStaticConstMacro(ChunkSize, unsigned int, 64);
+
+  struct ChunkType
+    {
+    TValue m_Values[ChunkSize];
+    ChunkType * m_Next;
+    };
+
+  inline ChunkType * Allocate()
+    {
+    if( !m_Free )
+      {
+      this->AddBlock( m_BlockSize );
+      // grow geometrically, up to 1M values per block
+      m_BlockSize = std::min( m_BlockSize * 2, 16384UL );
+      }
+    ChunkType * c = m_Free;
+    m_Free = c->m_Next;
+    c->m_Next = 0;
+    return c;
+    }
+
+  inline void Release( ChunkType * c )
+    {
+    c->m_Next = m_Free;
+    m_Free = c;
+    }
+
+  /** make sure that the free list holds enough chunks for n values,
+   * that is n / ChunkSize + 1 chunks. The fifos fill their chunks one
+   * at a time, so pushing the n values under k distinct keys may
+   * still need up to k - 1 more chunks */
+  void Reserve( unsigned long n )
+    {
+    unsigned long chunks = n / ChunkSize + 1;
+    for( ChunkType * c = m_Free; c && chunks; c = c->m_Next )
+      {
+      --chunks;
+      }
+    if( chunks )
+      {
+      this->AddBlock( chunks );
+      }
+    }
+
+  /** memory held by the pool, in bytes */
+  unsigned long GetMemorySize() const
+    {
+    return m_NumberOfChunks * sizeof( ChunkType );
+    }
+
+  HierarchicalQueueChunkPool()
+    {
+    m_Free = 0;
+    m_BlockSize = 16;
+    m_NumberOfChunks = 0;
+    }
+
+  ~HierarchicalQueueChunkPool()
+    {
+    for( typename std::vector<ChunkType *>::iterator it = m_Blocks.begin();
+         it != m_Blocks.end(); ++it )
+      {
+      delete [] *it;
+      }
+    }
+
+private:
+  HierarchicalQueueChunkPool(const HierarchicalQueueChunkPool &); // purposely not implemented
+  void operator=(const HierarchicalQueueChunkPool &); // purposely not implemented
+
+  void AddBlock( unsigned long n )
+    {
+    ChunkType * block = new ChunkType[n];
+    m_Blocks.push_back( block );
+    m_NumberOfChunks += n;
+    for( unsigned long i = 0; i < n; i++ )
+      {
+      this->Release( block + i );
+      }
+    }
+
+  ChunkType * m_Free;
+  unsigned long m_BlockSize;
+  unsigned long m_NumberOfChunks;
+  std::vector<ChunkType *> m_Blocks;
+};
+
+/** \class HierarchicalQueueFifo
+ *  \brief FIFO of values stored in a linked list of chunks from a
+ *  HierarchicalQueueChunkPool
+ *
+ * The fifo doesn't own its chunks - they must be given back to the
+ * pool by popping all the values.
+ */
+template <typename TValue>
+class HierarchicalQueueFifo
+{
+public:
+  typedef HierarchicalQueueChunkPool<TValue> PoolType;
+  typedef typename PoolType::ChunkType ChunkType;
+
+  inline bool empty() const
+    {
+    return m_Head == 0;
+    }
+
+  inline const TValue & front() const
+    {
+    return m_Head->m_Values[ m_HeadPos ];
+    }
+
+  inline void push_back( const TValue & v, PoolType & pool )
+    {
+    if( m_TailPos == PoolType::ChunkSize || !m_Tail )
+      {
+      ChunkType * c = pool.Allocate();
+      if( m_Tail )
+        {
+        m_Tail->m_Next = c;
+        }
+      else
+        {
+        m_Head = c;
+        m_HeadPos = 0;
+        }
+      m_Tail = c;
+      m_TailPos = 0;
+      }
+    m_Tail->m_Values[ m_TailPos++ ] = v;
+    }
+
+  inline void pop_front( PoolType & pool )
+    {
+    ++m_HeadPos;
+    if( m_Head == m_Tail && m_HeadPos == m_TailPos )
+      {
+      pool.Release( m_Head );
+      m_Head = m_Tail = 0;
+      m_HeadPos = m_TailPos = 0;
+      }
+    else if( m_HeadPos == PoolType::ChunkSize )
+      {
+      ChunkType * next = m_Head->m_Next;
+      pool.Release( m_Head );
+      m_Head = next;
+      m_HeadPos = 0;
+      }
+    }
+
+  HierarchicalQueueFifo()
+    {
+    m_Head = m_Tail = 0;
+    m_HeadPos = m_TailPos = 0;
+    }
+
+private:
+  ChunkType * m_Head;
+  ChunkType * m_Tail;
+  unsigned int m_HeadPos;
+  unsigned int m_TailPos;
+};
+
 /** \class HierarchicalQueue
  *  \brief HierarchicalQueue class
  * 
- * This class implement a priority queue based on list and map or list and vector,
- * depending on the key type. Image analysis are making a particular
+ * This class implement a priority queue based on fifos and map or fifos and vector,
+ * depending on the key type. The fifos are made of fixed size chunks
+ * recycled by the queue, so pushing and popping values doesn't call
+ * the allocator once the queue has reached its peak size. Image analysis are making a particular
  * usage of priority queue: there is a restricted set of keys, but a
  * very high number of values. This particularity make classical priority
  * queue implementations (with heap and vector or deque, like in STL) highly inefficient.
@@ -49,7 +228,8 @@ public:
   typedef TKey KeyType;
   typedef TCompare CompareType;
 
-  typedef std::list<ValueType>      ValueListType;
+  typedef HierarchicalQueueFifo<ValueType>      ValueListType;
+  typedef typename ValueListType::PoolType     PoolType;
   typedef std::map<KeyType, ValueListType, CompareType>  MapType;
 //   typedef std::Vector<ValueListType>  VectorType;
 
@@ -70,8 +250,9 @@ public:
   /** push a value in the queue */
   inline void Push( const KeyType & k, const ValueType & v)
     {
-    m_Map[k].push_back( v );
+    m_Map[k].push_back( v, m_Pool );
     m_Size++;
+    m_NumberOfPushes++;
     }
 
   /** return the size of the queue */
@@ -80,6 +261,13 @@ public:
     return m_Size;
     }
 
+  /** number of values pushed since the queue was created. They are
+   * all popped once the queue is empty */
+  unsigned long GetNumberOfPushes() const
+    {
+    return m_NumberOfPushes;
+    }
+
   /** return true if the queue is empty */
   inline const bool Empty() const
     {
@@ -91,7 +279,7 @@ public:
     {
     assert(!this->Empty());
     ValueListType & valueList = m_Map.begin()->second;
-    valueList.pop_front();
+    valueList.pop_front( m_Pool );
     if( valueList.empty() )
       {
       m_Map.erase( m_Map.begin() );
@@ -99,9 +287,35 @@ public:
     m_Size--;
     }
 
+  /** hint about the range of keys that will be pushed - not needed
+   * by this implementation */
+  void SetKeyRange( const KeyType &, const KeyType & ) {}
+
+  /** hint about the number of buckets to spread the key range over -
+   * not needed by this implementation */
+  void SetNumberOfBuckets( unsigned long ) {}
+
+  /** make room for n more values in the chunk pool. Values pushed
+   * under several keys may still need a few more chunks, see
+   * HierarchicalQueueChunkPool::Reserve */
+  void Reserve( unsigned long n )
+    {
+    m_Pool.Reserve( n );
+    }
+
+  /** approximate memory used by the queue, in bytes. The value
+   * storage is never released, so this is the largest it has been */
+  unsigned long GetMemorySize() const
+    {
+    // map nodes carry three pointers and a color on top of the pair
+    return m_Pool.GetMemorySize() +
+      m_Map.size() * ( sizeof( typename MapType::value_type ) + 4 * sizeof( void * ) );
+    }
+
   HierarchicalQueue()
     {
     m_Size = 0;
+    m_NumberOfPushes = 0;
     }
 
 
@@ -109,9 +323,11 @@ protected:
 
 private:
 
+  PoolType m_Pool;
   MapType m_Map;
 //   VactorType m_Vector;
   unsigned long m_Size;
+  unsigned long m_NumberOfPushes;
 
 };
 
@@ -130,7 +346,8 @@ public:
   typedef TKey KeyType;
   typedef TCompare CompareType;
 
-  typedef std::list<ValueType>      ValueListType;
+  typedef HierarchicalQueueFifo<ValueType>      ValueListType;
+  typedef typename ValueListType::PoolType     PoolType;
   typedef std::vector<ValueListType>  VectorType;
 
   // for code conciseness
@@ -156,12 +373,13 @@ public:
       assert( (int)(k  - NT::NonpositiveMin()) < (int)m_Vector.size() );
     assert( k  - NT::NonpositiveMin() >= 0 );
 
-    m_Vector[ k  - NT::NonpositiveMin() ].push_back( v );
+    m_Vector[ k  - NT::NonpositiveMin() ].push_back( v, m_Pool );
     if( this->Empty() || m_Compare( k, m_CurrentValue ) )
       {
       m_CurrentValue = k;
       }
     m_Size++;
+    m_NumberOfPushes++;
     }
 
   /** return the size of the queue */
@@ -170,6 +388,13 @@ public:
     return m_Size;
     }
 
+  /** number of values pushed since the queue was created. They are
+   * all popped once the queue is empty */
+  unsigned long GetNumberOfPushes() const
+    {
+    return m_NumberOfPushes;
+    }
+
   /** return true if the queue is empty */
   inline const bool Empty() const
     {
@@ -181,7 +406,7 @@ public:
     {
     assert(!this->Empty());
     ValueListType & valueList = m_Vector[ m_CurrentValue  - NT::NonpositiveMin() ];
-    valueList.pop_front();
+    valueList.pop_front( m_Pool );
     m_Size--;
 
     if( valueList.empty() && !this->Empty() )
@@ -195,6 +420,29 @@ public:
 
     }
 
+  /** hint about the range of keys that will be pushed - not needed
+   * by this implementation */
+  void SetKeyRange( const KeyType &, const KeyType & ) {}
+
+  /** hint about the number of buckets to spread the key range over -
+   * not needed by this implementation */
+  void SetNumberOfBuckets( unsigned long ) {}
+
+  /** make room for n more values in the chunk pool. Values pushed
+   * under several keys may still need a few more chunks, see
+   * HierarchicalQueueChunkPool::Reserve */
+  void Reserve( unsigned long n )
+    {
+    m_Pool.Reserve( n );
+    }
+
+  /** memory used by the queue, in bytes. The value storage is never
+   * released, so this is the largest it has been */
+  unsigned long GetMemorySize() const
+    {
+    return m_Pool.GetMemorySize() + m_Vector.capacity() * sizeof( ValueListType );
+    }
+
   VectorHierarchicalQueue()
     {
     m_Vector.resize( NT::max() - NT::NonpositiveMin() + 1 );
@@ -207,6 +455,7 @@ public:
       m_Direction = 1;
       }
     m_Size = 0;
+    m_NumberOfPushes = 0;
     // initialized to make valgrind happy
     m_CurrentValue = 0;
 
@@ -218,14 +467,313 @@ protected:
 
 private:
 
+  PoolType m_Pool;
   VectorType m_Vector;
   unsigned long m_Size;
+  unsigned long m_NumberOfPushes;
   TKey m_CurrentValue;
   TCompare m_Compare;
   signed int m_Direction;
 
 };
 
+/** \class BucketHierarchicalQueue
+ *  \brief Priority queue for floating point keys
+ *
+ * The key range set with SetKeyRange is split into a number of
+ * buckets of equal width, and values are stored in contiguous per
+ * bucket storage. The bucket at the front of the queue is sorted by
+ * key (stably, so values with equal keys stay in the order they have
+ * been pushed) when it reaches the front, and values pushed into it
+ * afterwards are inserted at their place. Only the ordering inside
+ * the front bucket costs more than O(1), so the number of buckets
+ * should be chosen so that there are few distinct keys per bucket.
+ *
+ * Keys outside the range are stored in the first or last bucket, so
+ * the range only affects performance, never the output order.
+ */
+template <typename TKey, typename TValue, typename TCompare >
+class BucketHierarchicalQueue
+{
+
+public:
+
+  /** Standard typedefs */
+  typedef BucketHierarchicalQueue      Self;
+
+  typedef TValue ValueType;
+  typedef TKey KeyType;
+  typedef TCompare CompareType;
+
+  // for code conciseness
+  typedef NumericTraits< TKey > NT;
+
+  /** return the current key */
+  inline const KeyType & FrontKey() const
+    {
+    assert(!this->Empty());
+    return m_Buckets[ m_CurrentBucket ].Front().first;
+    }
+
+  /** return the current value */
+  inline const ValueType & FrontValue() const
+    {
+    assert(!this->Empty());
+    return m_Buckets[ m_CurrentBucket ].Front().second;
+    }
+
+  /** push a value in the queue */
+  inline void Push( const KeyType & k, const ValueType & v)
+    {
+    const unsigned long b = this->GetBucket( k );
+    BucketType & bucket = m_Buckets[ b ];
+    if( this->Empty() || b < m_CurrentBucket )
+      {
+      // buckets before the current one are empty, so this one is
+      // trivially sorted
+      m_CurrentBucket = b;
+      bucket.m_Sorted = true;
+      }
+    bucket.Push( EntryType( k, v ), m_Compare );
+    m_Size++;
+    m_NumberOfPushes++;
+    }
+
+  /** return the size of the queue */
+  inline const unsigned long & Size() const
+    {
+    return m_Size;
+    }
+
+  /** number of values pushed since the queue was created. They are
+   * all popped once the queue is empty */
+  unsigned long GetNumberOfPushes() const
+    {
+    return m_NumberOfPushes;
+    }
+
+  /** return true if the queue is empty */
+  inline const bool Empty() const
+    {
+    return m_Size == 0;
+    }
+
+  /** remove the first element of the queue */
+  inline void Pop()
+    {
+    assert(!this->Empty());
+    BucketType & bucket = m_Buckets[ m_CurrentBucket ];
+    bucket.Pop();
+    m_Size--;
+
+    if( bucket.Empty() && !this->Empty() )
+      {
+      // move on to the next bucket and order it
+      do
+        {
+        ++m_CurrentBucket;
+        }
+      while( m_Buckets[ m_CurrentBucket ].Empty() );
+      m_Buckets[ m_CurrentBucket ].Sort( m_Compare );
+      }
+    }
+
+  /** set the range of keys covered by the buckets. Must be called
+   * while the queue is empty */
+  void SetKeyRange( const KeyType & lo, const KeyType & hi )
+    {
+    assert(this->Empty());
+    m_Low = static_cast<double>( lo );
+    m_High = static_cast<double>( hi );
+    this->UpdateScale();
+    }
+
+  /** set the number of buckets. Must be called while the queue is
+   * empty */
+  void SetNumberOfBuckets( unsigned long n )
+    {
+    assert(this->Empty());
+    if( n < 1 )
+      {
+      n = 1;
+      }
+    m_Buckets.resize( n );
+    this->UpdateScale();
+    }
+
+  unsigned long GetNumberOfBuckets() const
+    {
+    return m_Buckets.size();
+    }
+
+  /** values are stored per bucket, which keeps its storage between
+   * uses, so there is nothing useful to reserve */
+  void Reserve( unsigned long ) {}
+
+  /** memory used by the queue, in bytes. The buckets keep their
+   * storage, so this is close to the largest it has been */
+  unsigned long GetMemorySize() const
+    {
+    unsigned long size = m_Buckets.capacity() * sizeof( BucketType );
+    for( typename BucketVectorType::const_iterator it = m_Buckets.begin();
+         it != m_Buckets.end(); ++it )
+      {
+      size += it->m_Entries.capacity() * sizeof( EntryType );
+      }
+    return size;
+    }
+
+  BucketHierarchicalQueue()
+    {
+    m_Size = 0;
+    m_NumberOfPushes = 0;
+    m_CurrentBucket = 0;
+    m_Low = 0;
+    m_High = 0;
+    m_Reverse = m_Compare( NT::One, NT::Zero );
+    m_Buckets.resize( 1 );
+    this->UpdateScale();
+    }
+
+
+protected:
+
+private:
+
+  typedef std::pair<KeyType, ValueType> EntryType;
+
+  // orders entries by key only, so that stable algorithms preserve
+  // the push order of equal keys
+  struct EntryCompare
+    {
+    EntryCompare( const CompareType & c ) : m_Compare( c ) {}
+    bool operator()( const EntryType & a, const EntryType & b ) const
+      {
+      return m_Compare( a.first, b.first );
+      }
+    CompareType m_Compare;
+    };
+
+  struct BucketType
+    {
+    BucketType() : m_Head( 0 ), m_Sorted( false ) {}
+
+    bool Empty() const
+      {
+      return m_Head == m_Entries.size();
+      }
+
+    const EntryType & Front() const
+      {
+      return m_Entries[ m_Head ];
+      }
+
+    void Push( const EntryType & e, const CompareType & compare )
+      {
+      if( !m_Sorted || this->Empty() || !compare( e.first, m_Entries.back().first ) )
+        {
+        m_Entries.push_back( e );
+        }
+      else
+        {
+        // after any entry with the same key
+        m_Entries.insert( std::upper_bound( m_Entries.begin() + m_Head,
+                                            m_Entries.end(), e,
+                                            EntryCompare( compare ) ), e );
+        }
+      }
+
+    void Pop()
+      {
+      ++m_Head;
+      if( this->Empty() )
+        {
+        // keep the storage for later use
+        m_Entries.clear();
+        m_Head = 0;
+        m_Sorted = false;
+        }
+      else if( m_Head > 1024 && m_Head * 2 > m_Entries.size() )
+        {
+        m_Entries.erase( m_Entries.begin(), m_Entries.begin() + m_Head );
+        m_Head = 0;
+        }
+      }
+
+    void Sort( const CompareType & compare )
+      {
+      if( m_Sorted )
+        {
+        return;
+        }
+      std::stable_sort( m_Entries.begin() + m_Head, m_Entries.end(),
+                        EntryCompare( compare ) );
+      m_Sorted = true;
+      }
+
+    std::vector<EntryType> m_Entries;
+    typename std::vector<EntryType>::size_type m_Head;
+    bool m_Sorted;
+    };
+
+  typedef std::vector<BucketType> BucketVectorType;
+
+  inline unsigned long GetBucket( const KeyType & k ) const
+    {
+    const unsigned long last = m_Buckets.size() - 1;
+    const double pos = ( static_cast<double>( k ) - m_Low ) * m_Scale;
+    unsigned long b;
+    if( !( pos > 0 ) )
+      {
+      b = 0;
+      }
+    else if( pos >= last )
+      {
+      b = last;
+      }
+    else
+      {
+      b = static_cast<unsigned long>( pos );
+      }
+    return m_Reverse ? last - b : b;
+    }
+
+  void UpdateScale()
+    {
+    if( m_High > m_Low )
+      {
+      m_Scale = m_Buckets.size() / ( m_High - m_Low );
+      }
+    else
+      {
+      m_Scale = 0;
+      }
+    }
+
+  BucketVectorType m_Buckets;
+  unsigned long m_Size;
+  unsigned long m_NumberOfPushes;
+  unsigned long m_CurrentBucket;
+  double m_Low;
+  double m_High;
+  double m_Scale;
+  bool m_Reverse;
+  TCompare m_Compare;
+
+};
+
+template <typename TValue, typename TCompare >
+class HierarchicalQueue<float, TValue, TCompare>
+: public BucketHierarchicalQueue<float, TValue, TCompare>
+{
+};
+
+template <typename TValue, typename TCompare >
+class HierarchicalQueue<double, TValue, TCompare>
+: public BucketHierarchicalQueue<double, TValue, TCompare>
+{
+};
+
 template <typename TValue, typename TCompare >
 class HierarchicalQueue<unsigned char, TValue, TCompare>
 : public VectorHierarchicalQueue<unsigned char, TValue, TCompare>
@@ -0,0 +1,385 @@
+#ifndef __itkNeighborCountKernels_h
+#define __itkNeighborCountKernels_h
+
+#include <vector>
+#include <cstring>
+#include <itkSize.h>
+#include <itkOffset.h>
+#include <itkImageLinearConstIteratorWithIndex.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace itk
+{
+
+/** dst[x] += src[x] for the length bytes of two rows, 32 or 16 at a
+ * time when compiled for AVX2 or SSE2. The rows needn't be aligned. */
+inline void AddByteRows(unsigned char *dst, const unsigned char *src,
+			unsigned long length)
+{
+  unsigned long x = 0;
+#if defined(__AVX2__)
+  for (; x + 32 <= length; x += 32)
+    {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + x));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), _mm256_add_epi8(a, b));
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+  for (; x + 16 <= length; x += 16)
+    {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + x));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_add_epi8(a, b));
+    }
+#endif
+  for (; x < length; x++)
+    {
+    dst[x] += src[x];
+    }
+}
+
+/** whether the length bytes of a row are all zero. Skeletons are
+ * sparse, so most rows are, and needn't be counted */
+inline bool IsZeroRow(const unsigned char *row, unsigned long length)
+{
+  unsigned long x = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 16 <= length; x += 16)
+    {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) != 0xffff)
+      {
+      return false;
+      }
+    }
+#endif
+  for (; x < length; x++)
+    {
+    if (row[x])
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+/** dst[x] = (src[x] != 0) for the length voxels of a row */
+template <class TPixel>
+inline void NonZeroRow(unsigned char *dst, const TPixel *src, unsigned long length)
+{
+  for (unsigned long x = 0; x < length; x++)
+    {
+    dst[x] = (src[x] != 0);
+    }
+}
+
+/** byte rows are compared 16 at a time when compiled for SSE2 */
+inline void NonZeroRow(unsigned char *dst, const unsigned char *src, unsigned long length)
+{
+  unsigned long x = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  for (; x + 16 <= length; x += 16)
+    {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+    // 0xff where zero, so andnot leaves 1 where non zero
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x),
+		     _mm_andnot_si128(_mm_cmpeq_epi8(v, zero), one));
+    }
+#endif
+  for (; x < length; x++)
+    {
+    dst[x] = (src[x] != 0);
+    }
+}
+
+/** \class NeighborCountKernel
+ * \brief Counts the non zero neighbours of the voxels of a binary
+ * image under a cell connectivity, a whole line at a time.
+ *
+ * The image is held by the caller as a padded byte buffer: one byte
+ * per voxel, 1 for the foreground and 0 for the background, with a
+ * one voxel border of zeros, laid out like PaddedBitImage. The
+ * kernel only knows the size of the buffer and the offsets to the
+ * neighbours, so the same kernel serves several buffers of the same
+ * size, like the two buffers of a pass that reads one and writes the
+ * other.
+ *
+ * The cell connectivity is that of setCellConnectivity: the
+ * neighbours are the offsets with at least that many zeros, so 0 is
+ * 8 / 26 connectivity, 1 is 4 / 18 and 2 is 6 in 3D.
+ *
+ * CountLine adds the shifted neighbouring lines of a line, a byte
+ * per voxel (26 neighbours at most fit), with AddByteRows. CountVoxel
+ * sums the neighbours of a single voxel, for the filters that only
+ * look at a few voxels. CountForeground counts the neighbours of the
+ * whole foreground, and NextVoxel and WalkChain follow the curves of
+ * a skeleton from voxel to voxel, for the filters that walk its
+ * branches.
+ *
+ * \author Richard Beare
+ */
+template <unsigned int VDimension>
+class NeighborCountKernel
+{
+public:
+  typedef Size<VDimension> SizeType;
+  typedef Offset<VDimension> OffsetType;
+
+  NeighborCountKernel()
+    {
+    m_Size.Fill(0);
+    m_BufferSize = 0;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      m_Strides[d] = 0;
+      }
+    }
+
+  /** set the size of the image, without the border, and the
+   * connectivity */
+  void Initialize(const SizeType &size, unsigned cellConnectivity)
+    {
+    m_Size = size;
+    unsigned long total = 1;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      m_Strides[d] = total;
+      total *= size[d] + 2;
+      }
+    m_BufferSize = total;
+
+    // the offsets to the neighbours, in the order of itk::Neighborhood
+    m_Shifts.clear();
+    m_Offsets.clear();
+    OffsetType offset;
+    unsigned positions = 1;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      positions *= 3;
+      }
+    for (unsigned pos = 0; pos < positions; pos++)
+      {
+      long shift = 0;
+      unsigned zeros = 0;
+      unsigned rest = pos;
+      for (unsigned d = 0; d < VDimension; d++)
+	{
+	const long delta = (long)(rest % 3) - 1;
+	rest /= 3;
+	zeros += (delta == 0);
+	shift += delta * (long)m_Strides[d];
+	offset[d] = delta;
+	}
+      if (zeros < VDimension && zeros >= cellConnectivity)
+	{
+	m_Shifts.push_back(shift);
+	m_Offsets.push_back(offset);
+	}
+      }
+    }
+
+  const SizeType & GetSize() const
+    {
+    return m_Size;
+    }
+
+  /** number of bytes of a padded buffer, border included */
+  unsigned long GetBufferSize() const
+    {
+    return m_BufferSize;
+    }
+
+  /** number of lines along the first dimension */
+  unsigned long GetNumberOfLines() const
+    {
+    unsigned long lines = 1;
+    for (unsigned d = 1; d < VDimension; d++)
+      {
+      lines *= m_Size[d];
+      }
+    return lines;
+    }
+
+  /** largest difference between the number of a line and that of a
+   * line holding one of its neighbours */
+  unsigned long GetLineReach() const
+    {
+    unsigned long reach = 0;
+    unsigned long lines = 1;
+    for (unsigned d = 1; d < VDimension; d++)
+      {
+      reach += lines;
+      lines *= m_Size[d];
+      }
+    return reach;
+    }
+
+  /** offset of a voxel in the buffer, given its position relative to
+   * the first voxel of the image */
+  unsigned long ComputeOffset(const OffsetType &pos) const
+    {
+    unsigned long off = 0;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      off += (pos[d] + 1) * m_Strides[d];
+      }
+    return off;
+    }
+
+  /** offset of the first voxel of a line, lines being numbered in
+   * raster order */
+  unsigned long GetLineOffset(unsigned long line) const
+    {
+    unsigned long off = 1;
+    for (unsigned d = 1; d < VDimension; d++)
+      {
+      off += (line % m_Size[d] + 1) * m_Strides[d];
+      line /= m_Size[d];
+      }
+    return off;
+    }
+
+  /** write the foreground of a region of an image, which has the size
+   * of the kernel, in a buffer whose border is already zero */
+  template <class TImage>
+  void Fill(unsigned char *buffer, const TImage *image,
+	    const typename TImage::RegionType &region) const
+    {
+    ImageLinearConstIteratorWithIndex<TImage> it(image, region);
+    it.SetDirection(0);
+    for (it.GoToBegin(); !it.IsAtEnd(); it.NextLine())
+      {
+      NonZeroRow(buffer + ComputeOffset(it.GetIndex() - region.GetIndex()),
+		 image->GetBufferPointer() + image->ComputeOffset(it.GetIndex()),
+		 m_Size[0]);
+      }
+    }
+
+  /** counts[x] gets the number of non zero neighbours of the voxel at
+   * offset start + x, for x in [0, length) */
+  void CountLine(const unsigned char *buffer, unsigned long start,
+		 unsigned long length, unsigned char *counts) const
+    {
+    std::memset(counts, 0, length);
+    for (unsigned k = 0; k < m_Shifts.size(); k++)
+      {
+      AddByteRows(counts, buffer + start + m_Shifts[k], length);
+      }
+    }
+
+  /** number of non zero neighbours of the voxel at offset off */
+  unsigned CountVoxel(const unsigned char *buffer, unsigned long off) const
+    {
+    unsigned count = 0;
+    for (unsigned k = 0; k < m_Shifts.size(); k++)
+      {
+      count += buffer[off + m_Shifts[k]];
+      }
+    return count;
+    }
+
+  /** counts gets the number of non zero neighbours of each foreground
+   * voxel of buffer, and 0 for the background. counts is laid out
+   * like buffer, and only its voxels are written. The lines without
+   * foreground aren't counted. */
+  void CountForeground(const unsigned char *buffer, unsigned char *counts) const
+    {
+    const unsigned long lines = GetNumberOfLines();
+    for (unsigned long line = 0; line < lines; line++)
+      {
+      const unsigned long start = GetLineOffset(line);
+      if (IsZeroRow(buffer + start, m_Size[0]))
+	{
+	std::memset(counts + start, 0, m_Size[0]);
+	continue;
+	}
+      CountLine(buffer, start, m_Size[0], counts + start);
+      for (unsigned long x = 0; x < m_Size[0]; x++)
+	{
+	counts[start + x] *= buffer[start + x];
+	}
+      }
+    }
+
+  /** offset of the first non zero neighbour of the voxel at offset
+   * off, other than the voxel at offset previous, or off if there
+   * isn't any. The neighbours are taken in the order of
+   * itk::Neighborhood. */
+  unsigned long NextVoxel(const unsigned char *buffer, unsigned long off,
+			  unsigned long previous) const
+    {
+    for (unsigned k = 0; k < m_Shifts.size(); k++)
+      {
+      const unsigned long N = off + m_Shifts[k];
+      if (buffer[N] && N != previous)
+	{
+	return N;
+	}
+      }
+    return off;
+    }
+
+  /** follow a curve of the skeleton in buffer from the voxel at offset
+   * current, coming from the voxel at offset previous. The voxels
+   * with two neighbours in counts (see CountForeground) are appended
+   * to chain, up to the first voxel with another count, or up to stop
+   * on a closed curve, whose offset is returned. */
+  unsigned long WalkChain(const unsigned char *buffer, const unsigned char *counts,
+			  unsigned long previous, unsigned long current,
+			  unsigned long stop, std::vector<unsigned long> &chain) const
+    {
+    while (current != stop && counts[current] == 2)
+      {
+      chain.push_back(current);
+      const unsigned long next = NextVoxel(buffer, current, previous);
+      previous = current;
+      current = next;
+      }
+    return current;
+    }
+
+  /** position of a voxel relative to the first voxel of the image,
+   * from its offset in the buffer */
+  OffsetType ComputePosition(unsigned long off) const
+    {
+    OffsetType pos;
+    for (int d = VDimension - 1; d >= 0; d--)
+      {
+      pos[d] = off / m_Strides[d] - 1;
+      off %= m_Strides[d];
+      }
+    return pos;
+    }
+
+  /** offsets from a voxel to its neighbours in the buffer */
+  const std::vector<long> & GetShifts() const
+    {
+    return m_Shifts;
+    }
+
+  /** the same neighbours as image offsets */
+  const std::vector<OffsetType> & GetNeighborOffsets() const
+    {
+    return m_Offsets;
+    }
+
+private:
+  SizeType m_Size;
+  unsigned long m_Strides[VDimension];
+  unsigned long m_BufferSize;
+  std::vector<long> m_Shifts;
+  std::vector<OffsetType> m_Offsets;
+};
+
+} // end namespace itk
+
+#endif
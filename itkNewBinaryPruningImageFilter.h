@@ -20,6 +20,8 @@
 #include <itkImageToImageFilter.h>
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkNeighborhoodIterator.h>
+#include <itkMultiThreader.h>
+#include "itkNeighborCountKernels.h"
 
 namespace itk
 {
@@ -41,6 +43,15 @@ namespace itk
  * Digital Image Processing. 
  * Addison Wesley, 491-494, (1993).
  *
+ * The passes work in place on a padded byte copy of the foreground
+ * and count the neighbours a line at a time with
+ * NeighborCountKernel. A pass keeps the new values of the lines whose
+ * old values are still needed, about two planes per thread in 3D,
+ * and writes them back later. Each iteration is a pass over the
+ * whole image, its lines split between the threads (see
+ * SetNumberOfThreads). The passes stop early once one of them removes
+ * nothing, and the output is the input where the foreground survived.
+ *
  * \sa MorphologyImageFilter
  * \sa BinaryErodeImageFilter
  * \sa BinaryDilateImageFilter
@@ -137,12 +148,35 @@ protected:
   void GenerateData();
   void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
 
-  void doErode(typename TOutputImage::Pointer &t1, typename TOutputImage::Pointer &t2);
+  typedef NeighborCountKernel<itkGetStaticConstMacro(OutputImageDimension)> KernelType;
+
+  // one erosion pass over the lines [firstLine, lastLine) of the
+  // padded buffer, in place. A line is written back once the lines
+  // still to do no longer need it. The lines other threads need are
+  // left in held, to be written back by flushHeld once the pass is
+  // over. Returns whether an endpoint was removed
+  bool doErode(unsigned char *buffer, unsigned long firstLine,
+	       unsigned long lastLine, std::vector<unsigned char> &held) const;
+  void flushHeld(unsigned char *buffer, unsigned long firstLine,
+		 unsigned long lastLine, const std::vector<unsigned char> &held) const;
+
+  // data shared by the threads of a pass
+  struct ErodeThreadStruct
+  {
+    Self * Filter;
+    unsigned char * Buffer;
+    std::vector<unsigned char> Changed;
+    std::vector<unsigned long> FirstLine;
+    std::vector<unsigned long> LastLine;
+    std::vector<std::vector<unsigned char> > Held;
+  };
+  static ITK_THREAD_RETURN_TYPE ErodeThreaderCallback(void *arg);
 private:   
   NewBinaryPruningImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
   bool m_FullyConnected;
   unsigned int                  m_Iteration;
+  KernelType m_Kernel;
 
 }; // end of BinaryThinningImageFilter class
 
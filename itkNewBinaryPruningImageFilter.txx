@@ -4,14 +4,12 @@
 #include <iostream>
 
 #include "itkNewBinaryPruningImageFilter.h"
-#include "itkImageRegionConstIterator.h"
-#include "itkImageRegionIterator.h"
-#include "itkNeighborhoodIterator.h"
-#include "itkShapedNeighborhoodIterator.h"
-#include "itkConstShapedNeighborhoodIterator.h"
-#include "itkConnectedComponentAlgorithm.h"
+#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkImageLinearIteratorWithIndex.h"
 #include "itkSize.h"
-#include "itkConstantBoundaryCondition.h"
+#include "itkProgressReporter.h"
+#include <algorithm>
+#include <cstring>
 
 namespace itk
 {
@@ -62,55 +60,103 @@ NewBinaryPruningImageFilter<TInputImage,TOutputImage>
 }
 
 template <class TInputImage,class TOutputImage>
-void 
+bool
 NewBinaryPruningImageFilter<TInputImage,TOutputImage>
-::doErode(typename TOutputImage::Pointer &t1, typename TOutputImage::Pointer &t2) 
+::doErode(unsigned char *buffer, unsigned long firstLine,
+	  unsigned long lastLine, std::vector<unsigned char> &held) const
 {
-  typedef ConstShapedNeighborhoodIterator<OutputImageType> ShapedNeighborhoodIteratorType;
-  typename ShapedNeighborhoodIteratorType::RadiusType radius;
-  radius.Fill(1);
-  typename OutputImageType::RegionType region  = this->GetOutput()->GetRequestedRegion();
-
-  ShapedNeighborhoodIteratorType it(radius, t1, region);
-
-  ConstantBoundaryCondition<OutputImageType> bc;
-  bc.SetConstant(0);
-  it.OverrideBoundaryCondition(&bc);
-  setConnectivity( &it, m_FullyConnected );
-
-  typename ShapedNeighborhoodIteratorType::ConstIterator nIt;
-  ImageRegionIterator< TOutputImage > otA( t2,  region );
-
-  it.GoToBegin();
-  otA.GoToBegin();
-  while( ! it.IsAtEnd() )
+  const unsigned long length = m_Kernel.GetSize()[0];
+  const unsigned long reach = m_Kernel.GetLineReach();
+  std::vector<unsigned char> counts(length);
+
+  // the first reach lines are needed by the previous thread and are
+  // held until the end of the pass. The others go through a ring of
+  // reach + 1 lines, and the lines still in it at the end are needed
+  // by the next thread
+  const unsigned long ring = reach + 1;
+  held.resize(std::min(lastLine - firstLine, reach + ring) * length);
+
+  bool changed = false;
+  for (unsigned long line = firstLine; line < lastLine; line++)
     {
-    OutputPixelType V = it.GetCenterPixel();
-    if (V)
+    unsigned char *dst;
+    if (line - firstLine < reach)
       {
-      int genus = 0;
-      for (nIt = it.Begin(); nIt != it.End(); nIt++)
-	{
-	genus += (int)(nIt.Get() != 0);
-	}
-      if (genus < 2)
-	{
-	otA.Set( 0 );
-	}
-      else
+      dst = &held[(line - firstLine) * length];
+      }
+    else
+      {
+      dst = &held[(reach + (line - firstLine - reach) % ring) * length];
+      if (line - firstLine >= reach + ring)
 	{
-	otA.Set( V );
+	// nothing left to do reads this line any more
+	std::memcpy(buffer + m_Kernel.GetLineOffset(line - ring), dst, length);
 	}
       }
-    else 
+    const unsigned long start = m_Kernel.GetLineOffset(line);
+    const unsigned char *src = buffer + start;
+    if (IsZeroRow(src, length))
       {
-      otA.Set( 0 );
+      std::memset(dst, 0, length);
+      continue;
       }
+    m_Kernel.CountLine(buffer, start, length, &counts[0]);
+    for (unsigned long x = 0; x < length; x++)
+      {
+      // end points have less than two neighbours
+      dst[x] = src[x] & (counts[x] >= 2);
+      changed |= (src[x] != dst[x]);
+      }
+    }
+  return changed;
+}
 
-    ++it;
-    ++otA;
+template <class TInputImage,class TOutputImage>
+void
+NewBinaryPruningImageFilter<TInputImage,TOutputImage>
+::flushHeld(unsigned char *buffer, unsigned long firstLine,
+	    unsigned long lastLine, const std::vector<unsigned char> &held) const
+{
+  const unsigned long length = m_Kernel.GetSize()[0];
+  const unsigned long reach = m_Kernel.GetLineReach();
+  const unsigned long ring = reach + 1;
+  for (unsigned long line = firstLine; line < lastLine; line++)
+    {
+    if (line - firstLine < reach)
+      {
+      std::memcpy(buffer + m_Kernel.GetLineOffset(line),
+		  &held[(line - firstLine) * length], length);
+      }
+    else if (line + ring >= lastLine)
+      {
+      std::memcpy(buffer + m_Kernel.GetLineOffset(line),
+		  &held[(reach + (line - firstLine - reach) % ring) * length], length);
+      }
     }
 }
+
+template <class TInputImage,class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+NewBinaryPruningImageFilter<TInputImage,TOutputImage>
+::ErodeThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+    static_cast<MultiThreader::ThreadInfoStruct *>(arg);
+  ErodeThreadStruct * str = static_cast<ErodeThreadStruct *>(info->UserData);
+  const int threadId = info->ThreadID;
+  const int threadCount = info->NumberOfThreads;
+
+  // contiguous blocks of lines
+  const unsigned long lines = str->Filter->m_Kernel.GetNumberOfLines();
+  const unsigned long firstLine = (lines * threadId) / threadCount;
+  const unsigned long lastLine = (lines * (threadId + 1)) / threadCount;
+  str->FirstLine[threadId] = firstLine;
+  str->LastLine[threadId] = lastLine;
+  str->Changed[threadId] = str->Filter->doErode(str->Buffer, firstLine, lastLine,
+						str->Held[threadId]);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
 /**
  *  Generate PruneImage
  */
@@ -119,64 +165,65 @@ void
 NewBinaryPruningImageFilter<TInputImage,TOutputImage>
 ::GenerateData() 
 {
-
-#if 0
-  this->PrepareData();
-
-  itkDebugMacro(<< "GenerateData: Computing Thinning Image");
-  this->ComputePruneImage();
-#endif
-
   this->AllocateOutputs();
   InputImagePointer  inputImage  = this->GetInput();
   OutputImagePointer outputImage = this->GetOutput();
-  // allocate buffer images
-  typename OutputImageType::Pointer t1 = OutputImageType::New();
-  typename OutputImageType::Pointer t2 = OutputImageType::New();
   typename OutputImageType::RegionType region  = this->GetOutput()->GetRequestedRegion();
 
-  t1->SetRegions(region);
-  t2->SetRegions(region);
-
-  t1->Allocate();
-  t2->Allocate();
-  // Copy and cast input to a buffer image
-  ImageRegionConstIterator< TInputImage >  it( inputImage,  region );
-  ImageRegionIterator< TOutputImage > ot( t1,  region );
-
-  it.GoToBegin();
-  ot.GoToBegin();
+  ProgressReporter progress(this, 0, m_Iteration + 1);
 
-  itkDebugMacro(<< "PrepareData: Copy input to output");
- 
-  while( !ot.IsAtEnd() )
-    {
-    ot.Set( static_cast< typename OutputImageType::PixelType >( it.Get() ) );
-    ++it;
-    ++ot;
-    }
+  // the foreground in a padded byte buffer, which the passes update
+  // in place
+  m_Kernel.Initialize(region.GetSize(),
+		      m_FullyConnected ? 0 : OutputImageDimension - 1);
+  std::vector<unsigned char> buffer(m_Kernel.GetBufferSize(), 0);
+  m_Kernel.Fill(&buffer[0], inputImage.GetPointer(), region);
+  progress.CompletedPixel();
 
   // perform erosions
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+  const int threads = this->GetMultiThreader()->GetNumberOfThreads();
+  ErodeThreadStruct str;
+  str.Filter = this;
+  str.Buffer = &buffer[0];
+  str.Changed.resize(threads);
+  str.FirstLine.resize(threads);
+  str.LastLine.resize(threads);
+  str.Held.resize(threads);
+  this->GetMultiThreader()->SetSingleMethod(ErodeThreaderCallback, &str);
   for (unsigned i = 0; i < m_Iteration; i++)
     {
-    doErode(t1, t2);
-    std::swap(t1, t2);
+    std::fill(str.Changed.begin(), str.Changed.end(), 0);
+    std::fill(str.LastLine.begin(), str.LastLine.end(), 0);
+    this->GetMultiThreader()->SingleMethodExecute();
+    for (int t = 0; t < threads; t++)
+      {
+      if (str.LastLine[t] > str.FirstLine[t])
+	{
+	flushHeld(&buffer[0], str.FirstLine[t], str.LastLine[t], str.Held[t]);
+	}
+      }
+    progress.CompletedPixel();
+    if (std::find(str.Changed.begin(), str.Changed.end(), 1) == str.Changed.end())
+      {
+      // nothing removed, the next passes wouldn't either
+      break;
+      }
     }
-  // copy result to output
-  ImageRegionConstIterator< TOutputImage >  itA( t1,  region );
-  ImageRegionIterator< TOutputImage > otA( outputImage,  region );
-
-  itA.GoToBegin();
-  otA.GoToBegin();
 
-  itkDebugMacro(<< "PrepareData: Copy input to output");
- 
-  while( !otA.IsAtEnd() )
+  // the input where the foreground survived
+  ImageLinearConstIteratorWithIndex< TInputImage >  it( inputImage,  region );
+  ImageLinearIteratorWithIndex< TOutputImage > ot( outputImage,  region );
+  it.SetDirection(0);
+  ot.SetDirection(0);
+  for (it.GoToBegin(), ot.GoToBegin(); !ot.IsAtEnd(); it.NextLine(), ot.NextLine())
     {
-    otA.Set( itA.Get() );
-    ++itA;
-    ++otA;
-    }   
+    const unsigned char *kept = &buffer[0] + m_Kernel.ComputeOffset(ot.GetIndex() - region.GetIndex());
+    for (; !ot.IsAtEndOfLine(); ++it, ++ot, ++kept)
+      {
+      ot.Set( *kept ? static_cast< OutputPixelType >( it.Get() ) : 0 );
+      }
+    }
 } // end GenerateData()
 
 /**
@@ -0,0 +1,217 @@
+#ifndef __itkPaddedBitImage_h
+#define __itkPaddedBitImage_h
+
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <itkSize.h>
+#include <itkOffset.h>
+
+namespace itk
+{
+
+/** number of bits set in a word */
+inline unsigned BitCount(unsigned long v)
+{
+#if defined(__GNUC__)
+  return __builtin_popcountl(v);
+#else
+  unsigned c = 0;
+  for (; v; ++c)
+    {
+    v &= v - 1;
+    }
+  return c;
+#endif
+}
+
+/** position of the lowest bit set in a non zero word */
+inline unsigned LowestBit(unsigned long v)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzl(v);
+#else
+  unsigned c = 0;
+  for (; !(v & 1); ++c)
+    {
+    v >>= 1;
+    }
+  return c;
+#endif
+}
+
+/** \class PaddedBitImage
+ * \brief A binary image stored as one bit per voxel, with a one
+ * voxel border of zeros.
+ *
+ * Voxels are addressed by linear offsets into the padded
+ * buffer. Because of the border, the 3x3(x3) cube around any voxel
+ * of the image can be extracted without boundary checks. GetCube
+ * returns the cube as a bit mask in which bit i is the i'th position
+ * of a radius 1 itk::Neighborhood, so it is limited to images of
+ * dimension 3 or less.
+ *
+ * \author Richard Beare
+ */
+template <unsigned int VDimension>
+class PaddedBitImage
+{
+public:
+  typedef PaddedBitImage Self;
+  typedef Size<VDimension> SizeType;
+  typedef Offset<VDimension> OffsetType;
+  typedef unsigned long WordType;
+  typedef unsigned long OffsetValueType;
+  typedef unsigned int CubeType;
+
+  itkStaticConstMacro(WordBits, unsigned, sizeof(WordType) * CHAR_BIT);
+
+  PaddedBitImage()
+    {
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      m_Size[d] = 0;
+      m_Strides[d] = 0;
+      }
+    m_NumberOfPixels = 0;
+    }
+
+  /** allocate the buffer for an image of the given size. All voxels
+   * are set to zero */
+  void SetSize(const SizeType &size)
+    {
+    m_Size = size;
+    OffsetValueType total = 1;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      m_Strides[d] = total;
+      total *= size[d] + 2;
+      }
+    m_NumberOfPixels = total;
+    // one spare word so that GetCube can always read a word past the
+    // one holding the bit
+    m_Words.assign(total / WordBits + 2, 0);
+
+    // offsets from a voxel to the first voxel of each row of its
+    // cube, in the order used by itk::Neighborhood
+    unsigned rows = 1;
+    for (unsigned d = 1; d < VDimension; d++)
+      {
+      rows *= 3;
+      }
+    m_RowOffsets.resize(rows);
+    for (unsigned r = 0; r < rows; r++)
+      {
+      long off = -1;
+      unsigned rr = r;
+      for (unsigned d = 1; d < VDimension; d++)
+	{
+	off += ((long)(rr % 3) - 1) * (long)m_Strides[d];
+	rr /= 3;
+	}
+      m_RowOffsets[r] = off;
+      }
+    }
+
+  const SizeType & GetSize() const
+    {
+    return m_Size;
+    }
+
+  OffsetValueType GetStride(unsigned d) const
+    {
+    return m_Strides[d];
+    }
+
+  /** number of voxels, including the border */
+  OffsetValueType GetNumberOfPixels() const
+    {
+    return m_NumberOfPixels;
+    }
+
+  /** offset of a voxel, given its position relative to the first
+   * voxel of the image */
+  OffsetValueType ComputeOffset(const OffsetType &pos) const
+    {
+    OffsetValueType off = 0;
+    for (unsigned d = 0; d < VDimension; d++)
+      {
+      off += (pos[d] + 1) * m_Strides[d];
+      }
+    return off;
+    }
+
+  /** inverse of ComputeOffset */
+  OffsetType ComputePosition(OffsetValueType off) const
+    {
+    OffsetType pos;
+    for (int d = VDimension - 1; d >= 0; d--)
+      {
+      pos[d] = off / m_Strides[d] - 1;
+      off %= m_Strides[d];
+      }
+    return pos;
+    }
+
+  bool Get(OffsetValueType off) const
+    {
+    return (m_Words[off / WordBits] >> (off % WordBits)) & 1;
+    }
+
+  void Set(OffsetValueType off)
+    {
+    m_Words[off / WordBits] |= WordType(1) << (off % WordBits);
+    }
+
+  void Clear(OffsetValueType off)
+    {
+    m_Words[off / WordBits] &= ~(WordType(1) << (off % WordBits));
+    }
+
+  /** set or clear all the voxels, border included */
+  void Fill(bool value)
+    {
+    std::fill(m_Words.begin(), m_Words.end(), value ? ~WordType(0) : WordType(0));
+    }
+
+  /** the 3^VDimension voxels around off packed in a mask */
+  CubeType GetCube(OffsetValueType off) const
+    {
+    CubeType cube = 0;
+    for (unsigned r = 0; r < m_RowOffsets.size(); r++)
+      {
+      cube |= GetRow(off + m_RowOffsets[r]) << (3 * r);
+      }
+    return cube;
+    }
+
+  /** memory used by the buffer, in bytes */
+  unsigned long GetBufferSize() const
+    {
+    return m_Words.size() * sizeof(WordType);
+    }
+
+private:
+  // the 3 bits starting at off
+  CubeType GetRow(OffsetValueType off) const
+    {
+    const OffsetValueType w = off / WordBits;
+    const unsigned s = off % WordBits;
+    WordType v = m_Words[w] >> s;
+    if (s > WordBits - 3)
+      {
+      v |= m_Words[w + 1] << (WordBits - s);
+      }
+    return v & 7;
+    }
+
+  std::vector<WordType> m_Words;
+  std::vector<long> m_RowOffsets;
+  SizeType m_Size;
+  OffsetValueType m_Strides[VDimension];
+  OffsetValueType m_NumberOfPixels;
+};
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef __itkSeparableDistanceMapImageFilter_h
+#define __itkSeparableDistanceMapImageFilter_h
+
+#include <vector>
+#include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
+
+namespace itk
+{
+/** \class SeparableDistanceMapImageFilter
+ *
+ * \brief Exact euclidean distance map computed one dimension at a
+ * time
+ *
+ * Each non zero voxel of the input gets its distance to the nearest
+ * zero voxel, and zero voxels get zero. Voxels outside the image are
+ * not considered to be zero. If the input has no zero voxel, the
+ * foreground gets the maximum value of the output pixel type.
+ *
+ * The squared distances are computed by running the lower envelope
+ * of parabolas (see SquaredDistanceLine) over all the lines of the
+ * first dimension, then of the second and so on, as in the linear
+ * time algorithm of Maurer et al. The lines of a dimension are
+ * independent, so they are shared between the threads. The first
+ * pass reads the input and the last one writes the distances. In
+ * between, the squared distances are kept in the output buffer when
+ * the output pixel type is a floating point type, and in a temporary
+ * buffer of doubles otherwise. Each line is computed in double
+ * precision.
+ *
+ * Note that the foreground is the non zero part of the input, unlike
+ * DanielssonDistanceMapImageFilter that computes the distance to the
+ * non zero voxels.
+ *
+ * \author Richard Beare
+ */
+template <class TInputImage, class TOutputImage>
+class ITK_EXPORT SeparableDistanceMapImageFilter :
+    public ImageToImageFilter<TInputImage, TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef SeparableDistanceMapImageFilter Self;
+  typedef ImageToImageFilter<TInputImage, TOutputImage> Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(SeparableDistanceMapImageFilter, ImageToImageFilter);
+
+  typedef TInputImage InputImageType;
+  typedef TOutputImage OutputImageType;
+  typedef typename InputImageType::PixelType InputPixelType;
+  typedef typename OutputImageType::PixelType OutputPixelType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int,
+                      TInputImage::ImageDimension);
+
+  /** Set/Get whether the distances are physical distances or
+   * numbers of voxels. Defaults to true */
+  itkSetMacro(UseImageSpacing, bool);
+  itkGetConstReferenceMacro(UseImageSpacing, bool);
+  itkBooleanMacro(UseImageSpacing);
+
+protected:
+  SeparableDistanceMapImageFilter();
+  virtual ~SeparableDistanceMapImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  void GenerateInputRequestedRegion();
+  void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
+  void GenerateData();
+
+private:
+  SeparableDistanceMapImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  // one pass over the lines of a dimension. The squared distances
+  // are kept in Squared between the passes, or in the output buffer
+  // if it is null
+  struct PassStruct
+  {
+    Self * Filter;
+    unsigned Dimension;
+    const InputPixelType * Input;
+    OutputPixelType * Output;
+    double * Squared;
+  };
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback(void *arg);
+  template <class TStore>
+  void ThreadedPass(const PassStruct &str, TStore *store,
+		    unsigned threadId, unsigned threadCount);
+
+  bool m_UseImageSpacing;
+
+  // the layout of the input and output buffers
+  unsigned long m_Size[ImageDimension];
+  unsigned long m_Strides[ImageDimension];
+  double m_Spacing[ImageDimension];
+};
+
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSeparableDistanceMapImageFilter.txx"
+#endif
+
+#endif
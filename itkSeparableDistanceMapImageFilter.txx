@@ -0,0 +1,202 @@
+#ifndef __itkSeparableDistanceMapImageFilter_txx
+#define __itkSeparableDistanceMapImageFilter_txx
+
+#include <cmath>
+#include "itkSeparableDistanceMapImageFilter.h"
+#include "itkDistanceMapKernels.h"
+#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkImageLinearIteratorWithIndex.h"
+
+namespace itk
+{
+
+template <class TInputImage, class TOutputImage>
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::SeparableDistanceMapImageFilter()
+{
+  m_UseImageSpacing = true;
+}
+
+template <class TInputImage, class TOutputImage>
+void
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::GenerateInputRequestedRegion()
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+
+  // We need all the input.
+  InputImageType * input = const_cast<InputImageType *>(this->GetInput());
+  if ( !input )
+    { return; }
+  input->SetRequestedRegion( input->GetLargestPossibleRegion() );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *)
+{
+  this->GetOutput()
+    ->SetRequestedRegion( this->GetOutput()->GetLargestPossibleRegion() );
+}
+
+template <class TInputImage, class TOutputImage>
+void
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::GenerateData()
+{
+  this->AllocateOutputs();
+  const InputImageType * input = this->GetInput();
+  OutputImageType * output = this->GetOutput();
+  const typename OutputImageType::RegionType region = output->GetRequestedRegion();
+
+  unsigned long total = 1;
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    m_Size[d] = region.GetSize()[d];
+    m_Strides[d] = total;
+    total *= m_Size[d];
+    m_Spacing[d] = m_UseImageSpacing ? input->GetSpacing()[d] : 1.0;
+    }
+
+  // the input and output are both buffered over their largest
+  // region, so they have the same layout
+  PassStruct str;
+  str.Filter = this;
+  str.Input = input->GetBufferPointer() + input->ComputeOffset(region.GetIndex());
+  str.Output = output->GetBufferPointer() + output->ComputeOffset(region.GetIndex());
+  // the squared distances don't fit in integer outputs
+  std::vector<double> squared;
+  str.Squared = 0;
+  if (NumericTraits<OutputPixelType>::is_integer && ImageDimension > 1 && total > 0)
+    {
+    squared.resize(total);
+    str.Squared = &squared[0];
+    }
+
+  // the lines of each dimension in turn
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    str.Dimension = d;
+    this->GetMultiThreader()->SetSingleMethod(PassThreaderCallback, &str);
+    this->GetMultiThreader()->SingleMethodExecute();
+    this->UpdateProgress((d + 1.0) / ImageDimension);
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::PassThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+    static_cast<MultiThreader::ThreadInfoStruct *>(arg);
+  PassStruct * str = static_cast<PassStruct *>(info->UserData);
+  if (str->Squared)
+    {
+    str->Filter->ThreadedPass(*str, str->Squared, info->ThreadID, info->NumberOfThreads);
+    }
+  else
+    {
+    str->Filter->ThreadedPass(*str, str->Output, info->ThreadID, info->NumberOfThreads);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage>
+template <class TStore>
+void
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::ThreadedPass(const PassStruct &str, TStore *store,
+	       unsigned threadId, unsigned threadCount)
+{
+  const unsigned dimension = str.Dimension;
+  const bool firstPass = (dimension == 0);
+  const bool lastPass = (dimension == ImageDimension - 1);
+  const unsigned long n = m_Size[dimension];
+  const unsigned long stride = m_Strides[dimension];
+  unsigned long lines = 1;
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    if (d != dimension) lines *= m_Size[d];
+    }
+  if (n == 0) return;
+
+  // a contiguous share of the lines for each thread
+  const unsigned long first = lines * threadId / threadCount;
+  const unsigned long last = lines * (threadId + 1) / threadCount;
+
+  // the largest value of the store stands for the voxels without
+  // background found yet
+  const double infinity = NumericTraits<double>::max();
+  const TStore storeInfinity = NumericTraits<TStore>::max();
+  const OutputPixelType maxDistance = NumericTraits<OutputPixelType>::max();
+
+  std::vector<double> f(n), result(n), z(n + 1);
+  std::vector<unsigned long> v(n);
+  for (unsigned long line = first; line < last; line++)
+    {
+    // start of the line, from its position along the other dimensions
+    unsigned long start = 0;
+    unsigned long rest = line;
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      if (d == dimension) continue;
+      start += (rest % m_Size[d]) * m_Strides[d];
+      rest /= m_Size[d];
+      }
+
+    // the squared distance is zero on the background, unknown
+    // elsewhere, before the first pass
+    if (firstPass)
+      {
+      const InputPixelType * in = str.Input + start;
+      for (unsigned long i = 0; i < n; i++)
+	{
+	f[i] = (in[i * stride] != NumericTraits<InputPixelType>::Zero) ? infinity : 0;
+	}
+      }
+    else
+      {
+      const TStore * in = store + start;
+      for (unsigned long i = 0; i < n; i++)
+	{
+	f[i] = (in[i * stride] == storeInfinity) ? infinity : in[i * stride];
+	}
+      }
+    SquaredDistanceLine(&f[0], n, m_Spacing[dimension], &result[0], &v[0], &z[0]);
+    if (lastPass)
+      {
+      OutputPixelType * out = str.Output + start;
+      for (unsigned long i = 0; i < n; i++)
+	{
+	out[i * stride] = (result[i] == infinity) ? maxDistance :
+	  static_cast<OutputPixelType>(std::sqrt(result[i]));
+	}
+      }
+    else
+      {
+      TStore * out = store + start;
+      for (unsigned long i = 0; i < n; i++)
+	{
+	out[i * stride] = (result[i] >= storeInfinity) ? storeInfinity :
+	  static_cast<TStore>(result[i]);
+	}
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage>
+void
+SeparableDistanceMapImageFilter<TInputImage, TOutputImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "UseImageSpacing: " << m_UseImageSpacing << std::endl;
+}
+
+} // end namespace itk
+
+#endif
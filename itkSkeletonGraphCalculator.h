@@ -0,0 +1,171 @@
+#ifndef __itkSkeletonGraphCalculator_h
+#define __itkSkeletonGraphCalculator_h
+
+#include <vector>
+#include <itkObject.h>
+#include <itkImage.h>
+#include "itkNeighborCountKernels.h"
+
+namespace itk
+{
+/** \class SkeletonGraphCalculator
+ *
+ * \brief Converts a skeleton into a graph of nodes and edges
+ *
+ * The background of the skeleton image is assumed to be zero and the
+ * skeleton non zero. The neighbours of every skeleton voxel are
+ * counted by NeighborCountKernel, as in
+ * SpecialSkeletonPointsImageFilter, with the cell
+ * connectivity of setCellConnectivity, which must match that of the
+ * skeleton. The voxels that don't have exactly two neighbours (end
+ * points, branch points and isolated voxels) are the nodes of the
+ * graph, and the chains of voxels with two neighbours between them
+ * are the edges. Branch points that are next to each other are
+ * separate nodes, joined by edges without voxels. A closed curve
+ * without any node gets one, at its first voxel in raster order,
+ * with an edge from the node to itself.
+ *
+ * Compute() walks the skeleton once. The graph is stored in
+ * compressed sparse row form: the edges of node n are
+ * GetAdjacentEdges()[k] and the nodes at their other end
+ * GetAdjacentNodes()[k], for k in [GetAdjacencyStarts()[n],
+ * GetAdjacencyStarts()[n + 1]). Likewise the voxels of edge e,
+ * excluding the two nodes, are GetEdgeVoxels()[k] for k in
+ * [GetEdgeVoxelStarts()[e], GetEdgeVoxelStarts()[e + 1]), in order
+ * from the source node to the target node.
+ *
+ * The length of an edge is the sum of the lengths of its steps, from
+ * node to node, in physical units unless UseImageSpacing is off. When
+ * a radius image (usually the distance transform the skeleton was
+ * computed from) is given, each edge also gets the mean radius of its
+ * voxels, nodes included.
+ *
+ * \author Richard Beare
+ */
+template <class TSkeletonImage,
+	  class TRadiusImage = Image<float, TSkeletonImage::ImageDimension> >
+class ITK_EXPORT SkeletonGraphCalculator : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef SkeletonGraphCalculator Self;
+  typedef Object Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(SkeletonGraphCalculator, Object);
+
+  typedef TSkeletonImage SkeletonImageType;
+  typedef TRadiusImage RadiusImageType;
+  typedef typename SkeletonImageType::IndexType IndexType;
+  typedef std::vector<IndexType> IndexVec;
+  typedef std::vector<unsigned long> IdVec;
+
+  itkStaticConstMacro(ImageDimension, unsigned int,
+                      TSkeletonImage::ImageDimension);
+
+  /** an edge of the graph, between two nodes */
+  struct EdgeType
+  {
+    unsigned long Source;
+    unsigned long Target;
+    double Length;
+    double MeanRadius;
+  };
+  typedef std::vector<EdgeType> EdgeVec;
+
+  /** Set/Get the skeleton */
+  itkSetConstObjectMacro(Image, SkeletonImageType);
+  itkGetConstObjectMacro(Image, SkeletonImageType);
+
+  /** Set/Get the image the radius of the edges is sampled
+   * from. Optional */
+  itkSetConstObjectMacro(RadiusImage, RadiusImageType);
+  itkGetConstObjectMacro(RadiusImage, RadiusImageType);
+
+  itkSetMacro(ForegroundCellConnectivity, unsigned);
+  itkGetMacro(ForegroundCellConnectivity, unsigned);
+
+  /** Set/Get whether the edge lengths are physical lengths or numbers
+   * of voxel steps. Defaults to true */
+  itkSetMacro(UseImageSpacing, bool);
+  itkGetConstReferenceMacro(UseImageSpacing, bool);
+  itkBooleanMacro(UseImageSpacing);
+
+  /** Build the graph of the skeleton */
+  void Compute();
+
+  unsigned long GetNumberOfNodes() const
+  {
+    return m_NodeIndexes.size();
+  }
+  /** position of a node */
+  const IndexType & GetNodeIndex(unsigned long node) const
+  {
+    return m_NodeIndexes[node];
+  }
+  /** number of edge ends at a node - an edge from the node to itself
+   * counts twice */
+  unsigned long GetNodeDegree(unsigned long node) const
+  {
+    return m_AdjacencyStarts[node + 1] - m_AdjacencyStarts[node];
+  }
+
+  unsigned long GetNumberOfEdges() const
+  {
+    return m_Edges.size();
+  }
+  const EdgeType & GetEdge(unsigned long edge) const
+  {
+    return m_Edges[edge];
+  }
+
+  const IndexVec & GetNodeIndexes() const { return m_NodeIndexes; }
+  const EdgeVec & GetEdges() const { return m_Edges; }
+  const IdVec & GetAdjacencyStarts() const { return m_AdjacencyStarts; }
+  const IdVec & GetAdjacentNodes() const { return m_AdjacentNodes; }
+  const IdVec & GetAdjacentEdges() const { return m_AdjacentEdges; }
+  const IdVec & GetEdgeVoxelStarts() const { return m_EdgeVoxelStarts; }
+  const IndexVec & GetEdgeVoxels() const { return m_EdgeVoxels; }
+
+protected:
+  SkeletonGraphCalculator();
+  virtual ~SkeletonGraphCalculator() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  // add the edge walked from the node source through the voxels
+  // chain to the node target
+  void AddEdge(unsigned long source, unsigned long target,
+	       const IndexVec &chain);
+
+private:
+  SkeletonGraphCalculator(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  typedef NeighborCountKernel<itkGetStaticConstMacro(ImageDimension)> KernelType;
+
+  typename SkeletonImageType::ConstPointer m_Image;
+  typename RadiusImageType::ConstPointer m_RadiusImage;
+  unsigned m_ForegroundCellConnectivity;
+  bool m_UseImageSpacing;
+
+  IndexVec m_NodeIndexes;
+  EdgeVec m_Edges;
+  IdVec m_AdjacencyStarts;
+  IdVec m_AdjacentNodes;
+  IdVec m_AdjacentEdges;
+  IdVec m_EdgeVoxelStarts;
+  IndexVec m_EdgeVoxels;
+};
+
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSkeletonGraphCalculator.txx"
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef __itkSkeletonGraphCalculator_txx
+#define __itkSkeletonGraphCalculator_txx
+
+#include <cmath>
+#include <algorithm>
+
+#include "itkSkeletonGraphCalculator.h"
+
+namespace itk
+{
+
+template <class TSkeletonImage, class TRadiusImage>
+SkeletonGraphCalculator<TSkeletonImage, TRadiusImage>
+::SkeletonGraphCalculator()
+{
+  m_ForegroundCellConnectivity = 0;
+  m_UseImageSpacing = true;
+}
+
+template <class TSkeletonImage, class TRadiusImage>
+void
+SkeletonGraphCalculator<TSkeletonImage, TRadiusImage>
+::AddEdge(unsigned long source, unsigned long target, const IndexVec &chain)
+{
+  EdgeType edge;
+  edge.Source = source;
+  edge.Target = target;
+
+  // the path from node to node
+  IndexVec path;
+  path.reserve(chain.size() + 2);
+  path.push_back(m_NodeIndexes[source]);
+  path.insert(path.end(), chain.begin(), chain.end());
+  path.push_back(m_NodeIndexes[target]);
+
+  double length = 0;
+  for (unsigned long i = 1; i < path.size(); i++)
+    {
+    double step = 0;
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      double delta = path[i][d] - path[i - 1][d];
+      if (m_UseImageSpacing)
+	{
+	delta *= m_Image->GetSpacing()[d];
+	}
+      step += delta * delta;
+      }
+    length += std::sqrt(step);
+    }
+  edge.Length = length;
+
+  edge.MeanRadius = 0;
+  if (m_RadiusImage)
+    {
+    // a loop has its node once
+    const unsigned long voxels = (source == target) ? path.size() - 1 : path.size();
+    double sum = 0;
+    for (unsigned long i = 0; i < voxels; i++)
+      {
+      sum += m_RadiusImage->GetPixel(path[i]);
+      }
+    edge.MeanRadius = sum / voxels;
+    }
+
+  m_Edges.push_back(edge);
+  m_EdgeVoxels.insert(m_EdgeVoxels.end(), chain.begin(), chain.end());
+  m_EdgeVoxelStarts.push_back(m_EdgeVoxels.size());
+}
+
+template <class TSkeletonImage, class TRadiusImage>
+void
+SkeletonGraphCalculator<TSkeletonImage, TRadiusImage>
+::Compute()
+{
+  if (!m_Image)
+    {
+    itkExceptionMacro(<< "No skeleton image set");
+    }
+  const typename SkeletonImageType::RegionType region = m_Image->GetLargestPossibleRegion();
+
+  m_NodeIndexes.clear();
+  m_Edges.clear();
+  m_AdjacencyStarts.clear();
+  m_AdjacentNodes.clear();
+  m_AdjacentEdges.clear();
+  m_EdgeVoxelStarts.assign(1, 0);
+  m_EdgeVoxels.clear();
+
+  // the skeleton as a padded byte buffer, and the neighbour counts of
+  // its voxels
+  KernelType kernel;
+  kernel.Initialize(region.GetSize(), m_ForegroundCellConnectivity);
+  std::vector<unsigned char> buffer(kernel.GetBufferSize(), 0);
+  std::vector<unsigned char> counts(kernel.GetBufferSize(), 0);
+  kernel.Fill(&buffer[0], m_Image.GetPointer(), region);
+  kernel.CountForeground(&buffer[0], &counts[0]);
+
+  // the nodes are found in raster order, so their offsets are sorted
+  IdVec voxels;
+  IdVec nodeOffsets;
+  const unsigned long lines = kernel.GetNumberOfLines();
+  const unsigned long length = region.GetSize()[0];
+  for (unsigned long line = 0; line < lines; line++)
+    {
+    const unsigned long start = kernel.GetLineOffset(line);
+    for (unsigned long off = start; off < start + length; off++)
+      {
+      if (buffer[off] == 0) continue;
+      voxels.push_back(off);
+      if (counts[off] != 2)
+	{
+	nodeOffsets.push_back(off);
+	m_NodeIndexes.push_back(region.GetIndex() + kernel.ComputePosition(off));
+	}
+      }
+    }
+
+  // walk the chains leaving each node
+  std::vector<bool> visited(kernel.GetBufferSize(), false);
+  IdVec chain;
+  IndexVec chainIndexes;
+  const std::vector<long> &shifts = kernel.GetShifts();
+  const unsigned long branchNodes = nodeOffsets.size();
+  for (unsigned long node = 0; node < branchNodes; node++)
+    {
+    const unsigned long start = nodeOffsets[node];
+    for (unsigned k = 0; k < shifts.size(); k++)
+      {
+      const unsigned long off = start + shifts[k];
+      if (buffer[off] == 0) continue;
+      if (counts[off] != 2)
+	{
+	// two nodes side by side - the edge is added once, from the
+	// first node
+	const unsigned long other = std::lower_bound(nodeOffsets.begin(), nodeOffsets.end(), off)
+	  - nodeOffsets.begin();
+	if (node < other)
+	  {
+	  chainIndexes.clear();
+	  AddEdge(node, other, chainIndexes);
+	  }
+	continue;
+	}
+      if (visited[off])
+	{
+	// already walked from the other end
+	continue;
+	}
+
+      chain.clear();
+      const unsigned long end = kernel.WalkChain(&buffer[0], &counts[0], start, off, start, chain);
+      chainIndexes.clear();
+      for (IdVec::const_iterator C = chain.begin(); C != chain.end(); C++)
+	{
+	visited[*C] = true;
+	chainIndexes.push_back(region.GetIndex() + kernel.ComputePosition(*C));
+	}
+      const unsigned long other = std::lower_bound(nodeOffsets.begin(), nodeOffsets.end(), end)
+	- nodeOffsets.begin();
+      AddEdge(node, other, chainIndexes);
+      }
+    }
+
+  // closed curves without nodes
+  for (IdVec::const_iterator V = voxels.begin(); V != voxels.end(); V++)
+    {
+    if (counts[*V] != 2 || visited[*V]) continue;
+    const unsigned long node = m_NodeIndexes.size();
+    m_NodeIndexes.push_back(region.GetIndex() + kernel.ComputePosition(*V));
+    visited[*V] = true;
+
+    chain.clear();
+    kernel.WalkChain(&buffer[0], &counts[0], *V, kernel.NextVoxel(&buffer[0], *V, *V), *V, chain);
+    chainIndexes.clear();
+    for (IdVec::const_iterator C = chain.begin(); C != chain.end(); C++)
+      {
+      visited[*C] = true;
+      chainIndexes.push_back(region.GetIndex() + kernel.ComputePosition(*C));
+      }
+    AddEdge(node, node, chainIndexes);
+    }
+
+  // compressed adjacency
+  const unsigned long nodes = m_NodeIndexes.size();
+  m_AdjacencyStarts.assign(nodes + 1, 0);
+  for (typename EdgeVec::const_iterator E = m_Edges.begin(); E != m_Edges.end(); E++)
+    {
+    ++m_AdjacencyStarts[E->Source + 1];
+    ++m_AdjacencyStarts[E->Target + 1];
+    }
+  for (unsigned long node = 0; node < nodes; node++)
+    {
+    m_AdjacencyStarts[node + 1] += m_AdjacencyStarts[node];
+    }
+  m_AdjacentNodes.resize(m_AdjacencyStarts[nodes]);
+  m_AdjacentEdges.resize(m_AdjacencyStarts[nodes]);
+  IdVec fill(m_AdjacencyStarts.begin(), m_AdjacencyStarts.end() - 1);
+  for (unsigned long e = 0; e < m_Edges.size(); e++)
+    {
+    const EdgeType &edge = m_Edges[e];
+    m_AdjacentNodes[fill[edge.Source]] = edge.Target;
+    m_AdjacentEdges[fill[edge.Source]++] = e;
+    m_AdjacentNodes[fill[edge.Target]] = edge.Source;
+    m_AdjacentEdges[fill[edge.Target]++] = e;
+    }
+}
+
+template <class TSkeletonImage, class TRadiusImage>
+void
+SkeletonGraphCalculator<TSkeletonImage, TRadiusImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Connectivity: " << m_ForegroundCellConnectivity << std::endl;
+  os << indent << "UseImageSpacing: " << m_UseImageSpacing << std::endl;
+  os << indent << "NumberOfNodes: " << m_NodeIndexes.size() << std::endl;
+  os << indent << "NumberOfEdges: " << m_Edges.size() << std::endl;
+}
+
+} // end namespace itk
+
+#endif
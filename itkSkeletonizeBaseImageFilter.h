@@ -5,6 +5,12 @@
 #include <itkImageToImageFilter.h>
 #include <itkShapedNeighborhoodIterator.h>
 #include <itkNeighborhoodIterator.h>
+#include <itkProgressReporter.h>
+#include <itkMultiThreader.h>
+#include <itkSimpleFastMutexLock.h>
+#include "itkPaddedBitImage.h"
+#include "itkCubeConnectivityTable.h"
+#include "itkHierarchicalQueue.h"
 
 namespace itk
 {
@@ -60,6 +66,9 @@ public :
 		
   /** Declaration of pixel type. */
   typedef typename OutputImageType::PixelType OutputPixelType ;
+  typedef typename OrderingImageType::PixelType OrderingPixelType ;
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TImage::ImageDimension);
 		
   /** Set/Get the foreground value. Defaults to max */
   itkSetMacro(ForegroundValue, OutputPixelType);
@@ -74,37 +83,429 @@ public :
 
   itkSetMacro(BackgroundCellConnectivity, unsigned);
   itkGetMacro(BackgroundCellConnectivity, unsigned);
+
+  /** Set/Get whether the simplicity/terminality test is answered
+   * from a table indexed by the bit packed neighborhood of the
+   * voxel. In 2D the table has 256 entries and is filled when the
+   * connectivity is set up. In 3D it has 2^26 entries (16MB) that are
+   * filled on first use. Images of higher dimension always use the
+   * direct test. Defaults to true. */
+  itkSetMacro(UseSimplePointTable, bool);
+  itkGetConstReferenceMacro(UseSimplePointTable, bool);
+  itkBooleanMacro(UseSimplePointTable);
+
+  /** Set/Get the number of buckets the range of ordering values is
+   * split into by the priority queue when the ordering image has a
+   * floating point pixel type. More buckets mean fewer distinct
+   * values to sort per bucket. Has no effect on the result. Defaults
+   * to 4096. */
+  itkSetMacro(NumberOfQueueBuckets, unsigned long);
+  itkGetMacro(NumberOfQueueBuckets, unsigned long);
+
+  /** Set/Get whether the thinning is spread over several threads
+   * (see SetNumberOfThreads). The voxels with the lowest priority in
+   * the queue (within ParallelLevelWidth of it) are taken together
+   * and split into the 2^ImageDimension subfields of voxels with the
+   * same coordinate parities. No voxel of a subfield is in the cube
+   * of another, so a whole subfield can be tested in parallel and
+   * then removed, with the same topological guarantees as the serial
+   * algorithm. The order of removals isn't the serial one, so the
+   * skeleton may differ slightly from the serial result. Only used up
+   * to 3D. Defaults to false. */
+  itkSetMacro(ParallelThinning, bool);
+  itkGetConstReferenceMacro(ParallelThinning, bool);
+  itkBooleanMacro(ParallelThinning);
+
+  /** Set/Get the width of the band of ordering values taken together
+   * by the parallel thinning. Wider bands give the threads more work
+   * at once, at the cost of following the ordering less
+   * closely. Defaults to 0 - one ordering value at a time. */
+  itkSetMacro(ParallelLevelWidth, OrderingPixelType);
+  itkGetMacro(ParallelLevelWidth, OrderingPixelType);
+
+  /** Set/Get whether the objects of the image are thinned
+   * separately, on several threads. The nonzero voxels of the
+   * ordering image are split into 26 (8 in 2D) connected components,
+   * and each thread thins the next component not yet taken, the
+   * largest first, with its own queue on a copy of the component's
+   * bounding box. A removal never changes whether a voxel of another
+   * component is simple, so the result is the same as the serial
+   * one. Useful for images made of many objects, and used instead of
+   * ParallelThinning when both are set. Only used up to
+   * 3D. Defaults to false. */
+  itkSetMacro(ParallelComponentThinning, bool);
+  itkGetConstReferenceMacro(ParallelComponentThinning, bool);
+  itkBooleanMacro(ParallelComponentThinning);
+
+  /** Set/Get whether the ordering is quantized into unsigned short
+   * levels before the thinning. The priority queue of 8 and 16 bit
+   * orderings is a vector of fifos, indexed directly by the ordering
+   * value, which is much faster than the queues needed by floating
+   * point or wider orderings. When set, and the ordering has more
+   * than 16 bits, the non zero ordering values are mapped to levels
+   * of OrderingQuantum, from 1 for the smallest, and the thinning runs
+   * on the levels. Voxels whose orderings are in the same level are
+   * taken in raster order rather than in ordering order, so the
+   * skeleton is one that could be obtained from an ordering changed
+   * by less than OrderingQuantum: the topology is the same, but the
+   * skeleton may move by a voxel where the ordering is flatter than
+   * the quantum. The levels take an unsigned short image. Has no
+   * effect on 8 and 16 bit orderings. Defaults to false. */
+  itkSetMacro(QuantizeOrdering, bool);
+  itkGetConstReferenceMacro(QuantizeOrdering, bool);
+  itkBooleanMacro(QuantizeOrdering);
+
+  /** Set/Get the width of a level of the quantized ordering. Values
+   * too large for 65535 levels are put in the last one. Defaults to
+   * 0 - the range of the ordering split into 65535 levels. */
+  itkSetMacro(OrderingQuantum, double);
+  itkGetConstMacro(OrderingQuantum, double);
+
+  /** Set/Get the anchor image, an optional second input with the
+   * same region as the ordering image. The voxels of the mask that
+   * are non zero in the anchor image are never removed, as if they
+   * were terminal points: the skeleton keeps them and stays connected
+   * to them. Anchors outside the mask are ignored. They are flagged
+   * as already queued when the queue is filled, so they are never
+   * queued nor tested, and cost nothing in the thinning itself. The
+   * update throws an exception when the buffer of the anchor image
+   * doesn't contain the region being thinned. */
+  typedef TImage AnchorImageType;
+  typedef typename AnchorImageType::PixelType AnchorPixelType;
+  void SetAnchorImage(const AnchorImageType *anchors)
+    {
+    this->SetNthInput(1, const_cast<AnchorImageType *>(anchors));
+    }
+  const AnchorImageType * GetAnchorImage() const
+    {
+    return static_cast<const AnchorImageType *>(this->ProcessObject::GetInput(1));
+    }
+
+  /** Get the memory used by the last update on top of the input and
+   * output images, in bytes: bit images, queues (at their largest)
+   * and the simple point table. The bit images take one bit per
+   * voxel of the region, plus a border. */
+  itkGetConstMacro(WorkingMemorySize, unsigned long);
+
+  /** Skeletonize ordering into output without going through the
+   * pipeline, for sequences of many small images. The output gets the
+   * region and information of ordering, and keeps its buffer when it
+   * is large enough. The bit images and queue storage of the serial
+   * and subfield thinnings, and the quantized copy of the ordering,
+   * are kept by the filter from one call to the next and only grow,
+   * so a sequence of images of the same size is thinned without
+   * allocations. They are freed by ReleaseWorkingMemory, or by the
+   * next update. The input and output of the filter are left as they
+   * were. The anchor image, when set, must match each ordering image
+   * in turn.
+   *
+   *   for (i = 0; i < n; i++)
+   *     {
+   *     skel->ProcessImage(slices[i], skeletons[i]);
+   *     }
+   *   skel->ReleaseWorkingMemory();
+   */
+  void ProcessImage(const OrderingImageType *ordering, OutputImageType *output);
+
+  /** Free the storage kept by ProcessImage. An update frees it on
+   * its own. The connectivity tables and the simple point table,
+   * which only depend on the connectivities, are kept. */
+  void ReleaseWorkingMemory();
+
+  /** Get the number of voxels pushed on the priority queues by the
+   * last update, the mask voxels queued at the start included. Every
+   * pushed voxel is popped, so this is also the number of voxels
+   * tested. */
+  itkGetConstMacro(NumberOfQueuePushes, unsigned long);
+
+#ifdef SKEL_INSTRUMENT
+  /** Counters and timers of the last update, only available when
+   * the filter is compiled with SKEL_INSTRUMENT defined (see the
+   * SKEL_INSTRUMENT option of the CMake project).
+   *
+   * Pops are the voxels taken from the queues and tested, requeues
+   * the voxels queued again after the removal of a neighbor, so
+   * pushes are the initial voxels plus the requeues. Every tested
+   * voxel is either removed or rejected because it is a terminal
+   * point, its foreground neighbors don't form exactly one component
+   * or its background neighbors don't. The reason of a rejection is
+   * found by testing the cube again, which makes the instrumented
+   * filter slower, so its times should only be compared with other
+   * instrumented runs. The maximum queue size is that of the largest
+   * queue - the components each have their own.
+   *
+   * The times are in seconds: the setup of the connectivity tables
+   * and of the simple point table, the initialization of the queue
+   * from the ordering image, the thinning, and the copy of the
+   * result to the output. The components are written to the output
+   * by the threads thinning them, so the output time is then part
+   * of the thinning time. */
+  itkGetConstMacro(NumberOfQueuePops, unsigned long);
+  itkGetConstMacro(NumberOfRequeues, unsigned long);
+  itkGetConstMacro(NumberOfRemovals, unsigned long);
+  itkGetConstMacro(NumberOfTerminalRejections, unsigned long);
+  itkGetConstMacro(NumberOfForegroundRejections, unsigned long);
+  itkGetConstMacro(NumberOfBackgroundRejections, unsigned long);
+  itkGetConstMacro(MaximumQueueSize, unsigned long);
+  itkGetConstMacro(SetupTime, double);
+  itkGetConstMacro(InitializationTime, double);
+  itkGetConstMacro(ThinningTime, double);
+  itkGetConstMacro(OutputTime, double);
+#endif
 		
 protected :
 
   // structures to support fast connected component labelling of
   // neighborhoods
 
-  typedef std::vector<int> OffsetVecType;
-  typedef std::vector<OffsetVecType> OffsetImType;
+  typedef CubeConnectivityTable<itkGetStaticConstMacro(ImageDimension)> ConnectivityTableType;
 
   void SetupConnectivity();
-  unsigned genNeigCon(unsigned CellConnect);
+  unsigned genNeigCon(unsigned CellConnect) const;
   // a standard neighbourhood iterator
   typedef typename itk::NeighborhoodIterator<OutputImageType> CubeIteratorType;
 
   bool ComputeSimplicityTerminality(CubeIteratorType cubeIt,
 				    bool *cubeBuffer);
 
-  int countCC(bool cubeIm[],
-	      const OffsetImType &ConnectIm,
-	      const std::vector<bool> &ConnectivityTest,
-	      const std::vector<bool> &NeighConnectivityTest);
+  // the test itself, on a cube that has already been extracted
+  bool EvaluateCube(bool *cubeBuffer);
+
+  // Up to 3D the working copy of the output is a bit image, the cube
+  // around a voxel is a bit mask (bit i is the i'th position of the
+  // cube) and components are counted with mask operations.
+  typedef PaddedBitImage<itkGetStaticConstMacro(ImageDimension)> BitImageType;
+  typedef typename BitImageType::CubeType NeighborhoodCodeType;
+  typedef std::vector<NeighborhoodCodeType> MaskVecType;
+
+  bool IsRemovable(NeighborhoodCodeType cube);
+  // version that can be used by several threads: the table is only
+  // read, and the codes that weren't found are appended to misses
+  // with the result in the lowest bit, to be stored later by
+  // StoreSimplePoints
+  bool IsRemovable(NeighborhoodCodeType cube, MaskVecType &misses) const;
+  bool EvaluateCube(NeighborhoodCodeType cube) const;
+  int countCC(NeighborhoodCodeType cube,
+	      const MaskVecType &ConnectMasks,
+	      NeighborhoodCodeType ConnectivityTest,
+	      NeighborhoodCodeType NeighConnectivityTest) const;
+
+  // the lookup table is indexed by the cube with the centre bit
+  // removed
+  void SetupSimplePointTable();
+  bool LookupSimplePoint(NeighborhoodCodeType code);
+  void StoreSimplePoints(const MaskVecType &misses);
+  NeighborhoodCodeType CubeToCode(NeighborhoodCodeType cube) const
+    {
+    const NeighborhoodCodeType low = (NeighborhoodCodeType(1) << CentInd) - 1;
+    return (cube & low) | ((cube >> (CentInd + 1)) << CentInd);
+    }
+
+  int countCC(bool cubeIm[], const ConnectivityTableType &table);
 
   void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
 		
   SkeletonizeBaseImageFilter();
+  virtual ~SkeletonizeBaseImageFilter();
   SkeletonizeBaseImageFilter(Self const &); // Purposedly not implemented
   void operator=(Self const &); // Purposedly not implemented
 		
   void PrintSelf(std::ostream& os, Indent indent) const;
   void GenerateInputRequestedRegion();
   void GenerateData();
+
+  // the thinning itself when the cube fits in a bit mask, with a
+  // queue of TOffset
+  template <class TOffset>
+  void GenerateDataWithOffsets(ProgressReporter &progress);
+
+  // the thinning of a quantized copy of the ordering, by a filter
+  // with an unsigned short ordering
+  typedef Image<unsigned short, itkGetStaticConstMacro(ImageDimension)> QuantizedOrderingImageType;
+  typedef SkeletonizeBaseImageFilter<QuantizedOrderingImageType, TImage> QuantizedFilterType;
+  void GenerateDataQuantized();
+
+#ifdef SKEL_INSTRUMENT
+  // counts of a thinning, kept in its state so that the threads
+  // thinning components don't share them
+  struct ThinningCounters
+  {
+    unsigned long Pops;
+    unsigned long Requeues;
+    unsigned long Removals;
+    unsigned long TerminalRejections;
+    unsigned long ForegroundRejections;
+    unsigned long BackgroundRejections;
+    unsigned long MaximumQueueSize;
+    ThinningCounters()
+      : Pops(0), Requeues(0), Removals(0), TerminalRejections(0),
+	ForegroundRejections(0), BackgroundRejections(0), MaximumQueueSize(0) {}
+    void Add(const ThinningCounters &other)
+      {
+      Pops += other.Pops;
+      Requeues += other.Requeues;
+      Removals += other.Removals;
+      TerminalRejections += other.TerminalRejections;
+      ForegroundRejections += other.ForegroundRejections;
+      BackgroundRejections += other.BackgroundRejections;
+      MaximumQueueSize = std::max(MaximumQueueSize, other.MaximumQueueSize);
+      }
+  };
+
+  // count the reason why the cube of a voxel that isn't removable
+  // was rejected, by going through the tests of EvaluateCube again
+  void CountRejection(NeighborhoodCodeType cube, ThinningCounters &counters) const;
+  void CountRejection(bool *cubeBuffer, ThinningCounters &counters);
+  // copy the counters of the last thinning to the getters
+  void StoreCounters(const ThinningCounters &counters);
+#endif
+
+  // working data of GenerateDataWithOffsets
+  template <class TOffset>
+  struct ThinningState
+  {
+    BitImageType Foreground;
+    // voxels on the queue
+    BitImageType InQueue;
+    // voxels that are never removed, only set when UseAnchors is
+    // true. Only the state of the whole image has them.
+    BitImageType Anchors;
+    bool UseAnchors;
+    // ordering buffer, at the start of the region
+    const OrderingPixelType * Ordering;
+    long OrderingStrides[ImageDimension];
+    // offsets to the foreground neighbors in the bit image and in the
+    // ordering image
+    std::vector<long> BitNeighbors;
+    std::vector<long> OrderingNeighbors;
+#ifdef SKEL_INSTRUMENT
+    ThinningCounters Counters;
+#endif
+    ThinningState() : UseAnchors(false), Ordering(0) {}
+  };
+
+  // the states and queues kept between the calls of ProcessImage,
+  // selected by the type of the offsets
+  typedef HierarchicalQueue<OrderingPixelType, unsigned int,
+			    std::less<OrderingPixelType> > Queue32Type;
+  typedef HierarchicalQueue<OrderingPixelType, unsigned long,
+			    std::less<OrderingPixelType> > Queue64Type;
+  struct WorkingStorage
+  {
+    ThinningState<unsigned int> State32;
+    ThinningState<unsigned long> State64;
+    Queue32Type Queue32;
+    Queue64Type Queue64;
+  };
+  WorkingStorage & GetWorkingStorage()
+    {
+    if (!m_WorkingStorage)
+      {
+      m_WorkingStorage = new WorkingStorage;
+      }
+    return *m_WorkingStorage;
+    }
+  ThinningState<unsigned int> & GetWorkingState(unsigned int *) { return GetWorkingStorage().State32; }
+  ThinningState<unsigned long> & GetWorkingState(unsigned long *) { return GetWorkingStorage().State64; }
+  Queue32Type & GetWorkingQueue(unsigned int *) { return GetWorkingStorage().Queue32; }
+  Queue64Type & GetWorkingQueue(unsigned long *) { return GetWorkingStorage().Queue64; }
+
+  // fill the neighbor offsets of the state, once the foreground
+  // and ordering strides are set
+  template <class TOffset>
+  void InitializeNeighbors(ThinningState<TOffset> &state);
+
+  // remove a voxel and queue its unqueued neighbors
+  template <class TOffset, class TQueue>
+  void RemoveVoxel(ThinningState<TOffset> &state, TOffset current, TQueue &hq);
+
+  // when misses is given, the simple point table is only read, see
+  // IsRemovable
+  template <class TOffset, class TQueue>
+  void ThinSerial(ThinningState<TOffset> &state, TQueue &hq,
+		  ProgressReporter &progress, MaskVecType *misses = 0);
+
+  template <class TOffset, class TQueue>
+  void ThinBySubfields(ThinningState<TOffset> &state, TQueue &hq,
+		       ProgressReporter &progress);
+
+  // data passed to the threads testing a subfield
+  template <class TOffset>
+  struct SubfieldThreadStruct
+  {
+    const Self * Filter;
+    const BitImageType * Foreground;
+    const std::vector<TOffset> * Candidates;
+    std::vector<unsigned char> * Removable;
+    std::vector<MaskVecType> * Misses;
+  };
+
+  template <class TOffset>
+  static ITK_THREAD_RETURN_TYPE SubfieldThreaderCallback(void *arg);
+
+  // the per component thinning. state holds the whole foreground
+  template <class TOffset>
+  void ThinByComponents(ThinningState<TOffset> &state);
+
+  // what a thread keeps over the components it thins
+  struct ComponentTotals
+  {
+    // largest memory used by a component
+    unsigned long Memory;
+    unsigned long Pushes;
+#ifdef SKEL_INSTRUMENT
+    ThinningCounters Counters;
+#endif
+    ComponentTotals() : Memory(0), Pushes(0) {}
+  };
+
+  // thin the component made of the voxels [first, last) of the
+  // whole foreground, and write it to the output
+  template <class TOffset>
+  void ThinComponent(const ThinningState<TOffset> &global,
+		     const TOffset *first, const TOffset *last,
+		     OutputPixelType *output, const long *outputStrides,
+		     MaskVecType &misses, ComponentTotals &totals,
+		     ProgressReporter &progress);
+
+  // data shared by the threads thinning the components
+  template <class TOffset>
+  struct ComponentThreadStruct
+  {
+    Self * Filter;
+    const ThinningState<TOffset> * Global;
+    // the voxels of all the components, the ones of component c being
+    // [ComponentStarts[c], ComponentStarts[c + 1])
+    std::vector<TOffset> Voxels;
+    std::vector<unsigned long> ComponentStarts;
+    // (size, component), biggest first
+    std::vector<std::pair<unsigned long, unsigned long> > Order;
+    OutputPixelType * Output;
+    long OutputStrides[ImageDimension];
+    // the configurations missing from the simple point table, per
+    // thread. The table is only read while the threads run, and these
+    // are stored in it afterwards
+    std::vector<MaskVecType> Misses;
+    // guards NextComponent, Memory and Pushes
+    SimpleFastMutexLock Lock;
+    unsigned long NextComponent;
+    // sum of the largest memory used by each thread
+    unsigned long Memory;
+    unsigned long Pushes;
+#ifdef SKEL_INSTRUMENT
+    ThinningCounters Counters;
+#endif
+  };
+
+  template <class TOffset>
+  static ITK_THREAD_RETURN_TYPE ComponentThreaderCallback(void *arg);
+
+  // memory only needed for a part of the thinning, like the queue of
+  // a component - only the largest is kept
+  void NoteWorkingMemory(unsigned long bytes)
+    {
+    m_TransientMemorySize = std::max(m_TransientMemorySize, bytes);
+    }
 				
   unsigned m_ForegroundCellConnectivity;
   unsigned m_BackgroundCellConnectivity;
@@ -112,18 +513,67 @@ protected :
   OutputPixelType m_ForegroundValue;
   OutputPixelType m_BackgroundValue;
 
+  unsigned long m_NumberOfQueueBuckets;
 
-  OffsetImType m_FGConnect;
-  OffsetImType m_BGConnect;
+  bool m_ParallelThinning;
+  OrderingPixelType m_ParallelLevelWidth;
+  bool m_ParallelComponentThinning;
+  bool m_QuantizeOrdering;
+  double m_OrderingQuantum;
 
-  std::vector<bool> m_FGConnectivityTest;
-  std::vector<bool> m_BGConnectivityTest;
+  unsigned long m_WorkingMemorySize;
+  unsigned long m_TransientMemorySize;
+  unsigned long m_NumberOfQueuePushes;
 
-  std::vector<bool> m_FGNeighConnectivityTest;
-  std::vector<bool> m_BGNeighConnectivityTest;
+#ifdef SKEL_INSTRUMENT
+  unsigned long m_NumberOfQueuePops;
+  unsigned long m_NumberOfRequeues;
+  unsigned long m_NumberOfRemovals;
+  unsigned long m_NumberOfTerminalRejections;
+  unsigned long m_NumberOfForegroundRejections;
+  unsigned long m_NumberOfBackgroundRejections;
+  unsigned long m_MaximumQueueSize;
+  double m_SetupTime;
+  double m_InitializationTime;
+  double m_ThinningTime;
+  double m_OutputTime;
+#endif
+
+  ConnectivityTableType m_FGConnect;
+  ConnectivityTableType m_BGConnect;
 
 
   unsigned CentInd;
+
+  bool m_UseBitMasks;
+  MaskVecType m_FGConnectMasks;
+  MaskVecType m_BGConnectMasks;
+  NeighborhoodCodeType m_FGConnectivityMask;
+  NeighborhoodCodeType m_BGConnectivityMask;
+  NeighborhoodCodeType m_FGNeighConnectivityMask;
+  NeighborhoodCodeType m_BGNeighConnectivityMask;
+  NeighborhoodCodeType m_CubeMask;
+
+  // two bits per neighborhood code - known and removable
+  std::vector<unsigned char> m_SimplePointTable;
+  bool m_UseSimplePointTable;
+  bool m_SimplePointTableActive;
+  // connectivities used to fill the table, so it can be kept between
+  // updates
+  unsigned m_TableForegroundCellConnectivity;
+  unsigned m_TableBackgroundCellConnectivity;
+  // likewise for the connectivity tables
+  unsigned m_SetupForegroundCellConnectivity;
+  unsigned m_SetupBackgroundCellConnectivity;
+
+  // storage kept between the calls of ProcessImage, and freed at
+  // the end of an update, see ReleaseWorkingMemory. The queues can't
+  // be copied, so the storage is allocated on first use
+  WorkingStorage * m_WorkingStorage;
+  typename QuantizedOrderingImageType::Pointer m_QuantizedOrdering;
+  typename QuantizedFilterType::Pointer m_QuantizedFilter;
+  // set by ProcessImage
+  bool m_KeepWorkingMemory;
 		
 };
 	
@@ -2,14 +2,23 @@
 #define __itkSkeletonizeBaseImageFilter_txx
 
 #include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkImageLinearConstIteratorWithIndex.h>
+#include <itkImageLinearIteratorWithIndex.h>
+#include <itkImageRegionIterator.h>
 #include <itkNumericTraits.h>
 #include <itkProgressReporter.h>
 #include <itkConstantBoundaryCondition.h>
+#include <itkProgressAccumulator.h>
+#ifdef SKEL_INSTRUMENT
+#include <itkTimeProbe.h>
+#endif
 
 #include "itkSkeletonizeBaseImageFilter.h"
 #include "itkSkeletonConnectivity.h"
-#include "itkHierarchicalQueue.h"
 #include <queue>
+#include <algorithm>
+#include <functional>
+#include <cmath>
 
 //#define SKEL_DEBUG
 
@@ -31,6 +40,48 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
   this->SetForegroundCellConnectivity(0);
   this->SetBackgroundCellConnectivity(TImage::ImageDimension - 1);
 
+  m_UseSimplePointTable = true;
+  m_NumberOfQueueBuckets = 4096;
+  m_ParallelThinning = false;
+  m_ParallelLevelWidth = NumericTraits<OrderingPixelType>::Zero;
+  m_ParallelComponentThinning = false;
+  m_QuantizeOrdering = false;
+  m_OrderingQuantum = 0;
+  m_WorkingMemorySize = 0;
+  m_TransientMemorySize = 0;
+  m_NumberOfQueuePushes = 0;
+#ifdef SKEL_INSTRUMENT
+  StoreCounters(ThinningCounters());
+  m_SetupTime = 0;
+  m_InitializationTime = 0;
+  m_ThinningTime = 0;
+  m_OutputTime = 0;
+#endif
+  m_SimplePointTableActive = false;
+  m_TableForegroundCellConnectivity = NumericTraits<unsigned>::max();
+  m_TableBackgroundCellConnectivity = NumericTraits<unsigned>::max();
+  m_SetupForegroundCellConnectivity = NumericTraits<unsigned>::max();
+  m_SetupBackgroundCellConnectivity = NumericTraits<unsigned>::max();
+  m_WorkingStorage = 0;
+  m_KeepWorkingMemory = false;
+}
+
+template<class TOrderImage, class TImage>
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::~SkeletonizeBaseImageFilter()
+{
+  delete m_WorkingStorage;
+}
+
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ReleaseWorkingMemory()
+{
+  delete m_WorkingStorage;
+  m_WorkingStorage = 0;
+  m_QuantizedOrdering = 0;
+  m_QuantizedFilter = 0;
 }
 	
 	
@@ -47,6 +98,28 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
      <<  m_ForegroundCellConnectivity << std::endl;
   os << indent << "ForegroundValue: " << static_cast<typename NumericTraits<OutputPixelType>::PrintType>(m_ForegroundValue) << std::endl;
   os << indent << "BackgroundValue: " << static_cast<typename NumericTraits<OutputPixelType>::PrintType>(m_BackgroundValue) << std::endl;
+  os << indent << "UseSimplePointTable: " << m_UseSimplePointTable << std::endl;
+  os << indent << "NumberOfQueueBuckets: " << m_NumberOfQueueBuckets << std::endl;
+  os << indent << "ParallelThinning: " << m_ParallelThinning << std::endl;
+  os << indent << "ParallelLevelWidth: " << static_cast<typename NumericTraits<OrderingPixelType>::PrintType>(m_ParallelLevelWidth) << std::endl;
+  os << indent << "ParallelComponentThinning: " << m_ParallelComponentThinning << std::endl;
+  os << indent << "QuantizeOrdering: " << m_QuantizeOrdering << std::endl;
+  os << indent << "OrderingQuantum: " << m_OrderingQuantum << std::endl;
+  os << indent << "WorkingMemorySize: " << m_WorkingMemorySize << std::endl;
+  os << indent << "NumberOfQueuePushes: " << m_NumberOfQueuePushes << std::endl;
+#ifdef SKEL_INSTRUMENT
+  os << indent << "NumberOfQueuePops: " << m_NumberOfQueuePops << std::endl;
+  os << indent << "NumberOfRequeues: " << m_NumberOfRequeues << std::endl;
+  os << indent << "NumberOfRemovals: " << m_NumberOfRemovals << std::endl;
+  os << indent << "NumberOfTerminalRejections: " << m_NumberOfTerminalRejections << std::endl;
+  os << indent << "NumberOfForegroundRejections: " << m_NumberOfForegroundRejections << std::endl;
+  os << indent << "NumberOfBackgroundRejections: " << m_NumberOfBackgroundRejections << std::endl;
+  os << indent << "MaximumQueueSize: " << m_MaximumQueueSize << std::endl;
+  os << indent << "SetupTime: " << m_SetupTime << std::endl;
+  os << indent << "InitializationTime: " << m_InitializationTime << std::endl;
+  os << indent << "ThinningTime: " << m_ThinningTime << std::endl;
+  os << indent << "OutputTime: " << m_OutputTime << std::endl;
+#endif
 }
 	
 	
@@ -73,6 +146,12 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
   // configure the inputs such that all the data is available.
   //
   orderingPtr->SetRequestedRegion(orderingPtr->GetLargestPossibleRegion());
+
+  AnchorImageType * anchorPtr = const_cast< AnchorImageType * >(this->GetAnchorImage());
+  if ( anchorPtr )
+    {
+    anchorPtr->SetRequestedRegion(anchorPtr->GetLargestPossibleRegion());
+    }
 }
 	
 	
@@ -87,44 +166,182 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 	
 	
 	
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ProcessImage(const OrderingImageType *ordering, OutputImageType *output)
+{
+  if (!ordering || !output)
+    {
+    itkExceptionMacro(<< "ProcessImage needs an ordering and an output image");
+    }
+
+  // Allocate only reallocates when the buffer is too small
+  const typename OrderingImageType::RegionType region = ordering->GetLargestPossibleRegion();
+  output->CopyInformation(ordering);
+  output->SetRegions(region);
+  output->Allocate();
+
+  // the filter writes straight to the output, as a mini pipeline
+  // would. Its own input and output are put back afterwards, so it
+  // doesn't hold on to either image
+  OrderingImageConstPointerType input = this->GetInput();
+  typename OutputImageType::Pointer saved = OutputImageType::New();
+  saved->Graft(this->GetOutput());
+  this->SetInput(ordering);
+  this->GraftOutput(output);
+  m_KeepWorkingMemory = true;
+  try
+    {
+    this->GenerateData();
+    }
+  catch (...)
+    {
+    m_KeepWorkingMemory = false;
+    this->SetInput(input);
+    this->GraftOutput(saved);
+    throw;
+    }
+  m_KeepWorkingMemory = false;
+  this->SetInput(input);
+  this->GraftOutput(saved);
+}
+
 template<class TOrderImage, class TImage>
 void 
 SkeletonizeBaseImageFilter<TOrderImage, TImage>
 ::GenerateData()
 {
+  // the anchors are read straight from the buffer, over the whole
+  // region being thinned
+  const AnchorImageType * anchors = this->GetAnchorImage();
+  if (anchors &&
+      !anchors->GetBufferedRegion().IsInside(this->GetOutput()->GetRequestedRegion()))
+    {
+    itkExceptionMacro(<< "The anchor image region " << anchors->GetBufferedRegion()
+		      << " doesn't contain the region being thinned "
+		      << this->GetOutput()->GetRequestedRegion());
+    }
+
+  if (m_QuantizeOrdering && sizeof(OrderingPixelType) > sizeof(unsigned short))
+    {
+    GenerateDataQuantized();
+    if (!m_KeepWorkingMemory)
+      {
+      ReleaseWorkingMemory();
+      }
+    return;
+    }
+
   this->AllocateOutputs();
   typename OutputImageType::Pointer outputImage = this->GetOutput(0);
 		
-  outputImage->FillBuffer(m_BackgroundValue);
-
-  OrderingImageConstPointerType orderingImage = this->GetInput();
-		
+#ifdef SKEL_INSTRUMENT
+  TimeProbe setupTimer;
+  setupTimer.Start();
+#endif
   // set up structures for connected component labelling
   SetupConnectivity();
+  SetupSimplePointTable();
+#ifdef SKEL_INSTRUMENT
+  setupTimer.Stop();
+  m_SetupTime = setupTimer.GetMeanTime();
+  m_InitializationTime = 0;
+  m_ThinningTime = 0;
+  m_OutputTime = 0;
+#endif
+
+  ProgressReporter progress(this, 0, outputImage->GetRequestedRegion().GetNumberOfPixels()*2);
 
+  m_WorkingMemorySize = m_SimplePointTable.capacity();
+  m_TransientMemorySize = 0;
+  m_NumberOfQueuePushes = 0;
+
+  if (m_UseBitMasks)
+    {
+    // queue offsets into the bit image, using 32 bits when they are
+    // enough
+    unsigned long paddedPixels = 1;
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      paddedPixels *= outputImage->GetRequestedRegion().GetSize()[d] + 2;
+      }
+    if (paddedPixels <= NumericTraits<unsigned int>::max())
+      {
+      this->template GenerateDataWithOffsets<unsigned int>(progress);
+      }
+    else
+      {
+      this->template GenerateDataWithOffsets<unsigned long>(progress);
+      }
+    m_WorkingMemorySize += m_TransientMemorySize;
+    if (!m_KeepWorkingMemory)
+      {
+      ReleaseWorkingMemory();
+      }
+    return;
+    }
+
+  outputImage->FillBuffer(m_BackgroundValue);
+
+  OrderingImageConstPointerType orderingImage = this->GetInput();
 
   HierarchicalQueue<typename OrderingImageType::PixelType,
                      typename OrderingImageType::IndexType,
                      std::less<typename OrderingImageType::PixelType> > hq;
 
-  ProgressReporter progress(this, 0, outputImage->GetRequestedRegion().GetNumberOfPixels()*2);
-
   // collect nonzero voxels from the ordering image and put in the
   // priority queue
   typedef typename itk::ImageRegionConstIteratorWithIndex<OrderingImageType> ConstItType;
 
   ConstItType It(orderingImage, this->GetOutput()->GetRequestedRegion());
 
-  // an array to track which voxels are on the queue
-  bool* inQueue =
-    new bool[outputImage->GetRequestedRegion().GetNumberOfPixels()];
+  // the range of the keys lets queues for floating point keys spread
+  // them over buckets, and the number of keys lets the queue reserve
+  // its storage
+  unsigned long numberOfKeys = 0;
+  typename OrderingImageType::PixelType minKey =
+    NumericTraits<typename OrderingImageType::PixelType>::max();
+  typename OrderingImageType::PixelType maxKey =
+    NumericTraits<typename OrderingImageType::PixelType>::NonpositiveMin();
+  for (It.GoToBegin(); !It.IsAtEnd(); ++It)
+    {
+    typename OrderingImageType::PixelType V = It.Get();
+    if (V != NumericTraits<typename OrderingImageType::PixelType>::Zero)
+      {
+      minKey = std::min(minKey, V);
+      maxKey = std::max(maxKey, V);
+      ++numberOfKeys;
+      }
+    }
+  hq.Reserve(numberOfKeys);
+  hq.SetNumberOfBuckets(m_NumberOfQueueBuckets);
+  if (!(maxKey < minKey))
+    {
+    hq.SetKeyRange(minKey, maxKey);
+    }
+
+#ifdef SKEL_INSTRUMENT
+  ThinningCounters counters;
+  TimeProbe initTimer, thinTimer;
+  initTimer.Start();
+#endif
+  // track which voxels are on the queue, one bit per voxel
+  std::vector<bool> inQueue(outputImage->GetRequestedRegion().GetNumberOfPixels(), false);
 
+  const AnchorImageType * anchorImage = this->GetAnchorImage();
   for (It.GoToBegin(); !It.IsAtEnd();++It)
     {
     typename OrderingImageType::PixelType V = It.Get();
     if (V != itk::NumericTraits<typename OrderingImageType::PixelType>::Zero)
       {
-      hq.Push(V, It.GetIndex());
+      // anchors are flagged as queued without being queued, so they
+      // never are
+      if (!anchorImage ||
+	  anchorImage->GetPixel(It.GetIndex()) == NumericTraits<AnchorPixelType>::Zero)
+	{
+	hq.Push(V, It.GetIndex());
+	}
       outputImage->SetPixel(It.GetIndex(), m_ForegroundValue);
       // mark as on the queue
       inQueue[outputImage->ComputeOffset(It.GetIndex()) ] = true;
@@ -172,11 +389,20 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
   typename OrderingIteratorType::ConstIterator Nord;
   typename OutputIteratorType::ConstIterator Nout;
 
+#ifdef SKEL_INSTRUMENT
+  initTimer.Stop();
+  m_InitializationTime = initTimer.GetMeanTime();
+  counters.MaximumQueueSize = hq.Size();
+  thinTimer.Start();
+#endif
   while (!hq.Empty())
     {
     typename OrderingImageType::IndexType const current = hq.FrontValue();
     hq.Pop();
     inQueue[outputImage->ComputeOffset(current)] = false;
+#ifdef SKEL_INSTRUMENT
+    ++counters.Pops;
+#endif
 
     // could optimize slightly with offsets
     typename OrderingImageType::OffsetType shift = current - cubeIt.GetIndex();
@@ -189,6 +415,9 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
       {
       // this point can safely be removed
       outputImage->SetPixel(current, m_BackgroundValue);
+#ifdef SKEL_INSTRUMENT
+      ++counters.Removals;
+#endif
       // different shift because iterators can get out of sync
       typename OrderingImageType::OffsetType shift2 = current - ordIt.GetIndex();
       ordIt += shift2;
@@ -208,171 +437,863 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 	    // add the neighbour to the queue
 	    inQueue[OO] = true;
 	    hq.Push(P, Ind);
+#ifdef SKEL_INSTRUMENT
+	    ++counters.Requeues;
+	    counters.MaximumQueueSize = std::max(counters.MaximumQueueSize, hq.Size());
+#endif
 	    }
 	  }
 	
 	}
 
       }
+#ifdef SKEL_INSTRUMENT
+    else
+      {
+      // the test changed the cube, extract it again
+      for (unsigned pos = 0; pos < cubeIt.Size(); pos++)
+	{
+	cubeBuffer[pos] = (m_ForegroundValue == cubeIt.GetPixel(pos));
+	}
+      CountRejection(cubeBuffer, counters);
+      }
+#endif
     progress.CompletedPixel();
     }
-  delete[] inQueue;
   delete[] cubeBuffer;
+  m_WorkingMemorySize += inQueue.size() / CHAR_BIT + hq.GetMemorySize();
+  m_NumberOfQueuePushes += hq.GetNumberOfPushes();
+#ifdef SKEL_INSTRUMENT
+  thinTimer.Stop();
+  m_ThinningTime = thinTimer.GetMeanTime();
+  StoreCounters(counters);
+#endif
 }
 
 template<class TOrderImage, class TImage>
 void 
 SkeletonizeBaseImageFilter<TOrderImage, TImage>
-::SetupConnectivity()
+::GenerateDataQuantized()
 {
-  // set up our tables of offsets. We'll create a little image amd
-  // then use the neighborhood iterator to find out which neighbors
-  // are actually in the image
+  ProgressAccumulator::Pointer progress = ProgressAccumulator::New();
+  progress->SetMiniPipelineFilter(this);
 
-  typedef typename itk::Image<int, OrderingImageType::ImageDimension> ImType;
-
-  typename ImType::SizeType radius;
-  typename ImType::SizeType imsize;
-  radius.Fill(1);
-  imsize.Fill(3);
+  const OrderingImageType * orderingImage = this->GetInput();
+  const typename OrderingImageType::RegionType region = orderingImage->GetRequestedRegion();
 
-  typename ImType::Pointer smallIm = ImType::New();
-  typename ImType::RegionType region;
-  typename ImType::IndexType start;
-  start.Fill(0);
-  
-  region.SetSize(imsize);
-  region.SetIndex(start);
-  smallIm->SetRegions(region);
-  smallIm->Allocate();
+  // range of the non zero orderings
+  double minKey = NumericTraits<double>::max();
+  double maxKey = NumericTraits<double>::NonpositiveMin();
+  ImageRegionConstIterator<OrderingImageType> It(orderingImage, region);
+  for (It.GoToBegin(); !It.IsAtEnd(); ++It)
+    {
+    const OrderingPixelType V = It.Get();
+    if (V != NumericTraits<OrderingPixelType>::Zero)
+      {
+      minKey = std::min(minKey, (double)V);
+      maxKey = std::max(maxKey, (double)V);
+      }
+    }
 
-  typedef typename itk::ShapedNeighborhoodIterator<ImType> ShapedItType;
+  // level 0 is the background
+  const double levels = NumericTraits<unsigned short>::max();
+  double quantum = m_OrderingQuantum;
+  if (quantum <= 0)
+    {
+    quantum = (maxKey > minKey) ? (maxKey - minKey) / (levels - 1) : 1.0;
+    }
 
-  ShapedItType It(radius, smallIm, smallIm->GetLargestPossibleRegion());
+  // the quantized image and the filter thinning it are kept between
+  // the calls of ProcessImage, with their buffers
+  if (!m_QuantizedOrdering)
+    {
+    m_QuantizedOrdering = QuantizedOrderingImageType::New();
+    m_QuantizedFilter = QuantizedFilterType::New();
+    }
+  QuantizedOrderingImageType * quantized = m_QuantizedOrdering;
+  quantized->CopyInformation(orderingImage);
+  quantized->SetBufferedRegion(region);
+  quantized->SetRequestedRegion(region);
+  quantized->Allocate();
+  ImageRegionIterator<QuantizedOrderingImageType> Qt(quantized, region);
+  for (It.GoToBegin(); !It.IsAtEnd(); ++It, ++Qt)
+    {
+    const OrderingPixelType V = It.Get();
+    if (V == NumericTraits<OrderingPixelType>::Zero)
+      {
+      Qt.Set(0);
+      }
+    else
+      {
+      Qt.Set(static_cast<unsigned short>(std::min(levels, 1 + std::floor((V - minKey) / quantum))));
+      }
+    }
+  quantized->Modified();
+
+  QuantizedFilterType * skel = m_QuantizedFilter;
+  progress->RegisterInternalFilter(skel, 1.0f);
+  skel->SetInput(quantized);
+  skel->SetAnchorImage(this->GetAnchorImage());
+  skel->SetForegroundValue(m_ForegroundValue);
+  skel->SetBackgroundValue(m_BackgroundValue);
+  skel->SetForegroundCellConnectivity(m_ForegroundCellConnectivity);
+  skel->SetBackgroundCellConnectivity(m_BackgroundCellConnectivity);
+  skel->SetUseSimplePointTable(m_UseSimplePointTable);
+  skel->SetParallelThinning(m_ParallelThinning);
+  skel->SetParallelLevelWidth(static_cast<unsigned short>(
+				std::min(levels, std::floor(m_ParallelLevelWidth / quantum))));
+  skel->SetParallelComponentThinning(m_ParallelComponentThinning);
+  skel->SetNumberOfThreads(this->GetNumberOfThreads());
+  // the filter keeps its storage until it is released with this one
+  skel->ProcessImage(quantized, this->GetOutput());
+
+  m_NumberOfQueuePushes = skel->GetNumberOfQueuePushes();
+#ifdef SKEL_INSTRUMENT
+  m_NumberOfQueuePops = skel->GetNumberOfQueuePops();
+  m_NumberOfRequeues = skel->GetNumberOfRequeues();
+  m_NumberOfRemovals = skel->GetNumberOfRemovals();
+  m_NumberOfTerminalRejections = skel->GetNumberOfTerminalRejections();
+  m_NumberOfForegroundRejections = skel->GetNumberOfForegroundRejections();
+  m_NumberOfBackgroundRejections = skel->GetNumberOfBackgroundRejections();
+  m_MaximumQueueSize = skel->GetMaximumQueueSize();
+  m_SetupTime = skel->GetSetupTime();
+  m_InitializationTime = skel->GetInitializationTime();
+  m_ThinningTime = skel->GetThinningTime();
+  m_OutputTime = skel->GetOutputTime();
+#endif
+  m_WorkingMemorySize = skel->GetWorkingMemorySize() +
+    region.GetNumberOfPixels() * sizeof(unsigned short);
+}
 
-  setCellConnectivity(&It, m_ForegroundCellConnectivity);
-  ConstantBoundaryCondition<ImType> lcbc;
-  lcbc.SetConstant(-1 );
-  It.OverrideBoundaryCondition(&lcbc);
 
-  int idx = 0;
-  // first fill the image with indexes
-  // probably a better way of achieving this, but I can't be bothered
-  // figuring it out.
-  while (!It.IsAtEnd())
+template<class TOrderImage, class TImage>
+template<class TOffset>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::GenerateDataWithOffsets(ProgressReporter &progress)
+{
+  // Same algorithm as the index based version in GenerateData, but
+  // the queue holds offsets into a padded bit image holding the
+  // foreground, and the ordering image is read through its buffer.
+  typedef typename OrderingImageType::PixelType KeyType;
+  typename OutputImageType::Pointer outputImage = this->GetOutput(0);
+  OrderingImageConstPointerType orderingImage = this->GetInput();
+  const typename OutputImageType::RegionType region = outputImage->GetRequestedRegion();
+  const typename OutputImageType::IndexType start = region.GetIndex();
+
+  // the state and the queue are kept between the calls of
+  // ProcessImage, and their buffers only grow
+  ThinningState<TOffset> &state = this->GetWorkingState((TOffset *)0);
+#ifdef SKEL_INSTRUMENT
+  state.Counters = ThinningCounters();
+#endif
+  BitImageType &foreground = state.Foreground;
+  foreground.SetSize(region.GetSize());
+
+  // the ordering image is addressed relative to the start of the
+  // region
+  state.Ordering = orderingImage->GetBufferPointer() +
+    orderingImage->ComputeOffset(start);
+  for (unsigned d = 0; d < ImageDimension; d++)
     {
-    It.SetCenterPixel(idx);
-    ++idx;
-    ++It;
+    state.OrderingStrides[d] = orderingImage->GetOffsetTable()[d];
     }
 
-  OffsetImType FG, BG;
+  InitializeNeighbors(state);
+
+  const bool byComponents = m_ParallelComponentThinning &&
+    (this->GetNumberOfThreads() > 1);
+
+#ifdef SKEL_INSTRUMENT
+  TimeProbe initTimer, thinTimer, outputTimer;
+  initTimer.Start();
+#endif
+  HierarchicalQueue<KeyType, TOffset, std::less<KeyType> > &hq =
+    this->GetWorkingQueue((TOffset *)0);
+  const unsigned long previousPushes = hq.GetNumberOfPushes();
 
-  It.GoToBegin();
-  while (!It.IsAtEnd())
+  // collect nonzero voxels from the ordering image and put in the
+  // priority queue, a line at a time so that the offsets can simply
+  // be incremented
+  typedef ImageLinearConstIteratorWithIndex<OrderingImageType> ConstItType;
+  ConstItType It(orderingImage, region);
+  It.SetDirection(0);
+
+  // the range of the keys lets queues for floating point keys spread
+  // them over buckets, and the number of keys lets the queue reserve
+  // its storage
+  unsigned long numberOfKeys = 0;
+  KeyType minKey = NumericTraits<KeyType>::max();
+  KeyType maxKey = NumericTraits<KeyType>::NonpositiveMin();
+  for (It.GoToBegin(); !It.IsAtEnd(); It.NextLine())
     {
-    OffsetVecType OV;
-    //int Here = It.GetCenterPixel();
-    // check the neighbours
-    typename ShapedItType::ConstIterator nIt;
-    for (nIt = It.Begin(); nIt != It.End(); nIt++)
+    for (; !It.IsAtEndOfLine(); ++It)
       {
-      int There = nIt.Get();
-      if (There != -1)
+      const KeyType V = It.Get();
+      if (V != NumericTraits<KeyType>::Zero)
 	{
-	// we are inside the image
-	OV.push_back(There);
+	minKey = std::min(minKey, V);
+	maxKey = std::max(maxKey, V);
+	++numberOfKeys;
 	}
       }
-    FG.push_back(OV);
-    ++It;
     }
-  CentInd = It.GetCenterNeighborhoodIndex();
-  // now for the background
-  setCellConnectivity(&It, m_BackgroundCellConnectivity);
+  if (!byComponents)
+    {
+    hq.Reserve(numberOfKeys);
+    hq.SetNumberOfBuckets(m_NumberOfQueueBuckets);
+    if (!(maxKey < minKey))
+      {
+      hq.SetKeyRange(minKey, maxKey);
+      }
+    }
 
-  It.GoToBegin();
-  while (!It.IsAtEnd())
+  // a second bit image tracks which voxels are on the queue
+  state.InQueue.SetSize(region.GetSize());
+  // the anchors are flagged as queued when the queue is filled, by
+  // the components too, so that they are never queued
+  const AnchorImageType * anchorImage = this->GetAnchorImage();
+  state.UseAnchors = (anchorImage != 0);
+  if (state.UseAnchors)
     {
-    OffsetVecType OV;
-    //int Here = It.GetCenterPixel();
-    // check the neighbours
-    typename ShapedItType::ConstIterator nIt;
-    for (nIt = It.Begin(); nIt != It.End(); nIt++)
+    state.Anchors.SetSize(region.GetSize());
+    }
+  m_WorkingMemorySize += foreground.GetBufferSize() + state.InQueue.GetBufferSize() +
+    state.Anchors.GetBufferSize();
+
+  for (It.GoToBegin(); !It.IsAtEnd(); It.NextLine())
+    {
+    TOffset off = foreground.ComputeOffset(It.GetIndex() - start);
+    const AnchorPixelType * anchor = 0;
+    if (anchorImage)
+      {
+      anchor = anchorImage->GetBufferPointer() + anchorImage->ComputeOffset(It.GetIndex());
+      }
+    for (; !It.IsAtEndOfLine(); ++It, ++off)
       {
-      int There = nIt.Get();
-      if (There != -1)
+      bool anchored = false;
+      if (anchor)
 	{
-	// we are inside the image
-	OV.push_back(There);
+	anchored = (*anchor++ != NumericTraits<AnchorPixelType>::Zero);
 	}
+      const KeyType V = It.Get();
+      if (V != NumericTraits<KeyType>::Zero)
+	{
+	foreground.Set(off);
+	if (anchored)
+	  {
+	  state.Anchors.Set(off);
+	  }
+	if (!byComponents)
+	  {
+	  if (!anchored)
+	    {
+	    hq.Push(V, off);
+	    }
+	  state.InQueue.Set(off);
+	  }
+	}
+      progress.CompletedPixel();
       }
-    BG.push_back(OV);
-    ++It;
     }
+#ifdef SKEL_INSTRUMENT
+  initTimer.Stop();
+  m_InitializationTime = initTimer.GetMeanTime();
+  state.Counters.MaximumQueueSize = hq.Size();
+  thinTimer.Start();
+#endif
 
-  m_FGConnect = FG;
-  m_BGConnect = BG;
+  if (byComponents)
+    {
+    // the components are written to the output by the threads
+    ThinByComponents(state);
+    }
+  else if (m_ParallelThinning && this->GetNumberOfThreads() > 1)
+    {
+    ThinBySubfields(state, hq, progress);
+    }
+  else
+    {
+    ThinSerial(state, hq, progress);
+    }
+  this->NoteWorkingMemory(hq.GetMemorySize());
+  m_NumberOfQueuePushes += hq.GetNumberOfPushes() - previousPushes;
+#ifdef SKEL_INSTRUMENT
+  thinTimer.Stop();
+  m_ThinningTime = thinTimer.GetMeanTime();
+  StoreCounters(state.Counters);
+#endif
+  if (byComponents)
+    {
+    return;
+    }
 
-  {
-  // set up the connectivity test structures
-  std::vector<bool> F(FG.size(), false);
+#ifdef SKEL_INSTRUMENT
+  outputTimer.Start();
+#endif
+  // copy the result to the output
+  typedef ImageLinearIteratorWithIndex<OutputImageType> OutputItType;
+  OutputItType Ot(outputImage, region);
+  Ot.SetDirection(0);
+  for (Ot.GoToBegin(); !Ot.IsAtEnd(); Ot.NextLine())
+    {
+    TOffset off = foreground.ComputeOffset(Ot.GetIndex() - start);
+    for (; !Ot.IsAtEndOfLine(); ++Ot, ++off)
+      {
+      Ot.Set(foreground.Get(off) ? m_ForegroundValue : m_BackgroundValue);
+      }
+    }
+#ifdef SKEL_INSTRUMENT
+  outputTimer.Stop();
+  m_OutputTime = outputTimer.GetMeanTime();
+#endif
+}
 
-  for (unsigned K = 0; K < m_FGConnect[CentInd].size(); K++)
+template<class TOrderImage, class TImage>
+template<class TOffset>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::InitializeNeighbors(ThinningState<TOffset> &state)
+{
+  // offsets to the neighbors under the foreground connectivity, in
+  // the bit image and in the ordering image. Same order as the active
+  // offsets of a shaped iterator.
+  state.BitNeighbors.clear();
+  state.OrderingNeighbors.clear();
+  for (unsigned pos = 0; pos < (unsigned)ConnectivityTableType::Size; pos++)
     {
-    unsigned Idx =  m_FGConnect[CentInd][K];
-    F[Idx] = true;
+    if (!m_FGConnect.GetConnectivityTest(pos)) continue;
+    long bitOff = 0, ordOff = 0;
+    unsigned rest = pos;
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      const long delta = (long)(rest % 3) - 1;
+      rest /= 3;
+      bitOff += delta * (long)state.Foreground.GetStride(d);
+      ordOff += delta * state.OrderingStrides[d];
+      }
+    state.BitNeighbors.push_back(bitOff);
+    state.OrderingNeighbors.push_back(ordOff);
     }
+}
 
-  m_FGConnectivityTest = F;
+template<class TOrderImage, class TImage>
+template<class TOffset, class TQueue>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::RemoveVoxel(ThinningState<TOffset> &state, TOffset current, TQueue &hq)
+{
+  BitImageType &foreground = state.Foreground;
+  foreground.Clear(current);
+#ifdef SKEL_INSTRUMENT
+  ++state.Counters.Removals;
+#endif
 
-  std::vector<bool> B(BG.size(), false);
+  const typename BitImageType::OffsetType pos =
+    foreground.ComputePosition(current);
+  long ordCurrent = 0;
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    ordCurrent += pos[d] * state.OrderingStrides[d];
+    }
 
-  for (unsigned K = 0; K < m_BGConnect[CentInd].size(); K++)
+  // add unqueued neighbours. Voxels of the bit image are only set
+  // if they have a non zero ordering value, and the border is
+  // never set.
+  for (unsigned k = 0; k < state.BitNeighbors.size(); k++)
     {
-    unsigned Idx =  m_BGConnect[CentInd][K];
-    B[Idx] = true;
+    const TOffset N = current + state.BitNeighbors[k];
+    if (foreground.Get(N) && !state.InQueue.Get(N))
+      {
+      state.InQueue.Set(N);
+      hq.Push(state.Ordering[ordCurrent + state.OrderingNeighbors[k]], N);
+#ifdef SKEL_INSTRUMENT
+      ++state.Counters.Requeues;
+#endif
+      }
     }
+#ifdef SKEL_INSTRUMENT
+  state.Counters.MaximumQueueSize = std::max(state.Counters.MaximumQueueSize,
+					     (unsigned long)hq.Size());
+#endif
+}
 
-  m_BGConnectivityTest = B;
-  }
-  {
-  unsigned fgN = genNeigCon(m_ForegroundCellConnectivity);
-  unsigned bgN = genNeigCon(m_BackgroundCellConnectivity);
-  setCellConnectivity(&It, fgN);
+template<class TOrderImage, class TImage>
+template<class TOffset, class TQueue>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ThinSerial(ThinningState<TOffset> &state, TQueue &hq,
+	     ProgressReporter &progress, MaskVecType *misses)
+{
+  while (!hq.Empty())
+    {
+    const TOffset current = hq.FrontValue();
+    hq.Pop();
+    state.InQueue.Clear(current);
+#ifdef SKEL_INSTRUMENT
+    ++state.Counters.Pops;
+#endif
 
-  smallIm->FillBuffer(0);
-  typename ImType::IndexType middle;
-  middle.Fill(1);
-  
-  // set up the neighborhood connectivity test structures
-  std::vector<bool> F(FG.size(), false);
+    // evaluate terminality and simplicity criterion
+    const NeighborhoodCodeType cube = state.Foreground.GetCube(current);
+    if (misses ? IsRemovable(cube, *misses) : IsRemovable(cube))
+      {
+      // this point can safely be removed
+      RemoveVoxel(state, current, hq);
+      }
+#ifdef SKEL_INSTRUMENT
+    else
+      {
+      CountRejection(cube, state.Counters);
+      }
+#endif
+    progress.CompletedPixel();
+    }
+}
 
-  It += middle - It.GetIndex();
-  typename ShapedItType::ConstIterator nIt;
-  for (nIt = It.Begin(); nIt != It.End(); nIt++)
+template<class TOrderImage, class TImage>
+template<class TOffset, class TQueue>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ThinBySubfields(ThinningState<TOffset> &state, TQueue &hq,
+		  ProgressReporter &progress)
+{
+  // Voxels whose coordinates have the same parities are never in the
+  // cube of each other, so removing one of them doesn't change
+  // whether the others are simple. The voxels of the current level
+  // are split by parity, each subfield is tested by all the threads
+  // at once, and the removals are then applied in a single thread.
+  // Below this many candidates, the threads cost more than they save
+  const unsigned long minParallelCandidates = 512;
+  const unsigned subfields = 1 << ImageDimension;
+  const BitImageType &foreground = state.Foreground;
+
+  std::vector<std::vector<TOffset> > candidates(subfields);
+  std::vector<unsigned char> removable;
+  std::vector<MaskVecType> misses(this->GetNumberOfThreads());
+
+  SubfieldThreadStruct<TOffset> str;
+  str.Filter = this;
+  str.Foreground = &foreground;
+  str.Removable = &removable;
+  str.Misses = &misses;
+
+  while (!hq.Empty())
     {
-    typename ImType::IndexType Neighbour = middle + nIt.GetNeighborhoodOffset();
-    F[smallIm->ComputeOffset(Neighbour)] = true;
+    const OrderingPixelType level = hq.FrontKey();
+    while (!hq.Empty() &&
+	   !(m_ParallelLevelWidth < static_cast<OrderingPixelType>(hq.FrontKey() - level)))
+      {
+      const TOffset current = hq.FrontValue();
+      hq.Pop();
+#ifdef SKEL_INSTRUMENT
+      ++state.Counters.Pops;
+#endif
+      const typename BitImageType::OffsetType pos =
+	foreground.ComputePosition(current);
+      unsigned sub = 0;
+      for (unsigned d = 0; d < ImageDimension; d++)
+	{
+	sub |= (pos[d] & 1) << d;
+	}
+      candidates[sub].push_back(current);
+      }
+
+    for (unsigned sub = 0; sub < subfields; sub++)
+      {
+      std::vector<TOffset> &cand = candidates[sub];
+      if (cand.empty()) continue;
+      // the candidates of this subfield can be queued again by the
+      // removals in the next ones, but not the other way round
+      for (unsigned long i = 0; i < cand.size(); i++)
+	{
+	state.InQueue.Clear(cand[i]);
+	}
+
+      removable.resize(cand.size());
+      if (cand.size() < minParallelCandidates)
+	{
+	for (unsigned long i = 0; i < cand.size(); i++)
+	  {
+	  removable[i] = IsRemovable(foreground.GetCube(cand[i]));
+	  }
+	}
+      else
+	{
+	str.Candidates = &cand;
+	this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+	this->GetMultiThreader()->SetSingleMethod(
+	  &Self::template SubfieldThreaderCallback<TOffset>, &str);
+	this->GetMultiThreader()->SingleMethodExecute();
+	// the threads can't write in the table, so the configurations
+	// they had to evaluate are stored now
+	for (unsigned t = 0; t < misses.size(); t++)
+	  {
+	  StoreSimplePoints(misses[t]);
+	  misses[t].clear();
+	  }
+	}
+
+      for (unsigned long i = 0; i < cand.size(); i++)
+	{
+	if (removable[i])
+	  {
+	  RemoveVoxel(state, cand[i], hq);
+	  }
+#ifdef SKEL_INSTRUMENT
+	else
+	  {
+	  // the removals in the subfield don't change the cube
+	  CountRejection(foreground.GetCube(cand[i]), state.Counters);
+	  }
+#endif
+	progress.CompletedPixel();
+	}
+      cand.clear();
+      }
     }
+}
 
+template<class TOrderImage, class TImage>
+template<class TOffset>
+ITK_THREAD_RETURN_TYPE
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::SubfieldThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+    static_cast<MultiThreader::ThreadInfoStruct *>(arg);
+  const SubfieldThreadStruct<TOffset> * str =
+    static_cast<SubfieldThreadStruct<TOffset> *>(info->UserData);
+  const unsigned threadId = info->ThreadID;
+  const unsigned threadCount = info->NumberOfThreads;
+
+  // each thread tests a contiguous part of the candidates
+  const std::vector<TOffset> &cand = *str->Candidates;
+  const unsigned long first = cand.size() * threadId / threadCount;
+  const unsigned long last = cand.size() * (threadId + 1) / threadCount;
+  std::vector<unsigned char> &removable = *str->Removable;
+  MaskVecType &misses = (*str->Misses)[threadId];
+  for (unsigned long i = first; i < last; i++)
+    {
+    removable[i] = str->Filter->IsRemovable(str->Foreground->GetCube(cand[i]),
+					    misses);
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TOrderImage, class TImage>
+template<class TOffset>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ThinByComponents(ThinningState<TOffset> &state)
+{
+  const BitImageType &foreground = state.Foreground;
+  typename OutputImageType::Pointer outputImage = this->GetOutput(0);
+  const typename OutputImageType::RegionType region = outputImage->GetRequestedRegion();
+
+  ComponentThreadStruct<TOffset> str;
+  str.Filter = this;
+  str.Global = &state;
+  str.NextComponent = 0;
+  str.Memory = 0;
+  str.Pushes = 0;
+  str.Output = outputImage->GetBufferPointer() +
+    outputImage->ComputeOffset(region.GetIndex());
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    str.OutputStrides[d] = outputImage->GetOffsetTable()[d];
+    }
+  // the threads only write the voxels of the skeleton
+  outputImage->FillBuffer(m_BackgroundValue);
+
+  // the components have to be separated by the whole cube, whatever
+  // the foreground connectivity, for the removals in one of them not
+  // to change the cubes of the others
+  std::vector<long> cubeNeighbors;
+  for (unsigned pos = 0; pos < (unsigned)ConnectivityTableType::Size; pos++)
+    {
+    if (pos == CentInd) continue;
+    long bitOff = 0;
+    unsigned rest = pos;
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      bitOff += ((long)(rest % 3) - 1) * (long)foreground.GetStride(d);
+      rest /= 3;
+      }
+    cubeNeighbors.push_back(bitOff);
+    }
+
+  // label the components by a breadth first search, using the voxel
+  // list itself as the fifo. InQueue isn't used by this mode, so it
+  // marks the voxels already labelled.
+  std::vector<TOffset> &voxels = str.Voxels;
+  std::vector<unsigned long> &starts = str.ComponentStarts;
+  BitImageType &labelled = state.InQueue;
+  const TOffset total = foreground.GetNumberOfPixels();
+  for (TOffset off = 0; off < total; off++)
+    {
+    if (!foreground.Get(off) || labelled.Get(off)) continue;
+    starts.push_back(voxels.size());
+    labelled.Set(off);
+    voxels.push_back(off);
+    for (unsigned long i = starts.back(); i < voxels.size(); i++)
+      {
+      for (unsigned k = 0; k < cubeNeighbors.size(); k++)
+	{
+	const TOffset N = voxels[i] + cubeNeighbors[k];
+	if (foreground.Get(N) && !labelled.Get(N))
+	  {
+	  labelled.Set(N);
+	  voxels.push_back(N);
+	  }
+	}
+      }
+    // back to raster order, which is the order of the serial queue
+    std::sort(voxels.begin() + starts.back(), voxels.end());
+    str.Order.push_back(std::make_pair((unsigned long)(voxels.size() - starts.back()),
+				       (unsigned long)(starts.size() - 1)));
+    }
+  starts.push_back(voxels.size());
+  // the biggest components first, so that a big one doesn't keep a
+  // single thread busy at the end
+  std::sort(str.Order.begin(), str.Order.end(),
+	    std::greater<std::pair<unsigned long, unsigned long> >());
+
+  str.Misses.resize(this->GetNumberOfThreads());
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+  this->GetMultiThreader()->SetSingleMethod(
+    &Self::template ComponentThreaderCallback<TOffset>, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  // the threads are done - the table can be written
+  for (unsigned t = 0; t < str.Misses.size(); t++)
+    {
+    StoreSimplePoints(str.Misses[t]);
+    }
+
+  m_NumberOfQueuePushes += str.Pushes;
+#ifdef SKEL_INSTRUMENT
+  state.Counters.Add(str.Counters);
+#endif
+  this->NoteWorkingMemory(str.Memory + voxels.capacity() * sizeof(TOffset) +
+			  starts.capacity() * sizeof(unsigned long) +
+			  str.Order.capacity() * sizeof(std::pair<unsigned long, unsigned long>));
+}
+
+template<class TOrderImage, class TImage>
+template<class TOffset>
+ITK_THREAD_RETURN_TYPE
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ComponentThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+    static_cast<MultiThreader::ThreadInfoStruct *>(arg);
+  ComponentThreadStruct<TOffset> * str =
+    static_cast<ComponentThreadStruct<TOffset> *>(info->UserData);
+
+  // the first half of the progress is the initialisation. Only the
+  // first thread reports, so use an even share of the voxels.
+  ProgressReporter progress(str->Filter, info->ThreadID,
+			    str->Voxels.size() / info->NumberOfThreads + 1,
+			    100, 0.5, 0.5);
+  // the table is shared and read only until all the threads are
+  // done, so the configurations evaluated are kept aside. The same
+  // ones come back in every component, so duplicates are dropped as
+  // the list grows.
+  MaskVecType &misses = str->Misses[info->ThreadID];
+  unsigned long compacted = 0;
+  ComponentTotals totals;
+  for (;;)
+    {
+    if (misses.size() > 2 * compacted + 1024)
+      {
+      std::sort(misses.begin(), misses.end());
+      misses.erase(std::unique(misses.begin(), misses.end()), misses.end());
+      compacted = misses.size();
+      }
+    str->Lock.Lock();
+    const unsigned long next = str->NextComponent++;
+    str->Lock.Unlock();
+    if (next >= str->Order.size())
+      {
+      break;
+      }
+    const unsigned long c = str->Order[next].second;
+    const TOffset * voxels = &str->Voxels[0];
+    str->Filter->ThinComponent(*str->Global,
+			       voxels + str->ComponentStarts[c],
+			       voxels + str->ComponentStarts[c + 1],
+			       str->Output, str->OutputStrides,
+			       misses, totals, progress);
+    }
+  str->Lock.Lock();
+  str->Memory += totals.Memory;
+  str->Pushes += totals.Pushes;
+#ifdef SKEL_INSTRUMENT
+  str->Counters.Add(totals.Counters);
+#endif
+  str->Lock.Unlock();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template<class TOrderImage, class TImage>
+template<class TOffset>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::ThinComponent(const ThinningState<TOffset> &global,
+		const TOffset *first, const TOffset *last,
+		OutputPixelType *output, const long *outputStrides,
+		MaskVecType &misses, ComponentTotals &totals,
+		ProgressReporter &progress)
+{
+  typedef typename BitImageType::OffsetType PositionType;
+  const BitImageType &globalForeground = global.Foreground;
+
+  // bounding box of the component
+  PositionType lower = globalForeground.ComputePosition(*first);
+  PositionType upper = lower;
+  for (const TOffset *p = first; p != last; ++p)
+    {
+    const PositionType pos = globalForeground.ComputePosition(*p);
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      lower[d] = std::min(lower[d], pos[d]);
+      upper[d] = std::max(upper[d], pos[d]);
+      }
+    }
 
-  m_FGNeighConnectivityTest = F;
+  // a state for the bounding box only. The bit image brings the one
+  // voxel border.
+  ThinningState<TOffset> state;
+  typename BitImageType::SizeType size;
+  state.Ordering = global.Ordering;
+  long outputStart = 0;
+  for (unsigned d = 0; d < ImageDimension; d++)
+    {
+    size[d] = upper[d] - lower[d] + 1;
+    state.OrderingStrides[d] = global.OrderingStrides[d];
+    state.Ordering += lower[d] * global.OrderingStrides[d];
+    outputStart += lower[d] * outputStrides[d];
+    }
+  state.Foreground.SetSize(size);
+  InitializeNeighbors(state);
+
+  // the local offsets, in the same raster order as the global ones
+  std::vector<TOffset> local(last - first);
+  std::vector<long> ordOffsets(last - first);
+  OrderingPixelType minKey = NumericTraits<OrderingPixelType>::max();
+  OrderingPixelType maxKey = NumericTraits<OrderingPixelType>::NonpositiveMin();
+  for (unsigned long i = 0; i < local.size(); i++)
+    {
+    const PositionType pos = globalForeground.ComputePosition(first[i]) - lower;
+    local[i] = state.Foreground.ComputeOffset(pos);
+    long ordOff = 0;
+    for (unsigned d = 0; d < ImageDimension; d++)
+      {
+      ordOff += pos[d] * state.OrderingStrides[d];
+      }
+    ordOffsets[i] = ordOff;
+    minKey = std::min(minKey, state.Ordering[ordOff]);
+    maxKey = std::max(maxKey, state.Ordering[ordOff]);
+    }
 
-  std::vector<bool> B(BG.size(), false);
-  setCellConnectivity(&It, bgN);
+  HierarchicalQueue<OrderingPixelType, TOffset, std::less<OrderingPixelType> > hq;
+  hq.Reserve(local.size());
+  hq.SetNumberOfBuckets(m_NumberOfQueueBuckets);
+  hq.SetKeyRange(minKey, maxKey);
 
-  It += middle - It.GetIndex();
-  for (nIt = It.Begin(); nIt != It.End(); nIt++)
+  state.InQueue.SetSize(size);
+  for (unsigned long i = 0; i < local.size(); i++)
     {
-    typename ImType::IndexType Neighbour = middle + nIt.GetNeighborhoodOffset();
-    B[smallIm->ComputeOffset(Neighbour)] = true;
+    if (!global.UseAnchors || !global.Anchors.Get(first[i]))
+      {
+      hq.Push(state.Ordering[ordOffsets[i]], local[i]);
+      }
+    state.Foreground.Set(local[i]);
+    state.InQueue.Set(local[i]);
     }
+#ifdef SKEL_INSTRUMENT
+  state.Counters.MaximumQueueSize = hq.Size();
+#endif
 
-  m_BGNeighConnectivityTest = B;
+  ThinSerial(state, hq, progress, &misses);
+  // the components of a thread are thinned one after the other
+  totals.Memory = std::max(totals.Memory, state.Foreground.GetBufferSize() +
+			   state.InQueue.GetBufferSize() + hq.GetMemorySize());
+  totals.Pushes += hq.GetNumberOfPushes();
+#ifdef SKEL_INSTRUMENT
+  totals.Counters.Add(state.Counters);
+#endif
 
-  }
+  // the components don't share any voxel, so the threads don't write
+  // the same pixels
+  for (unsigned long i = 0; i < local.size(); i++)
+    {
+    if (state.Foreground.Get(local[i]))
+      {
+      const PositionType pos = state.Foreground.ComputePosition(local[i]);
+      long outOff = outputStart;
+      for (unsigned d = 0; d < ImageDimension; d++)
+	{
+	outOff += pos[d] * outputStrides[d];
+	}
+      output[outOff] = m_ForegroundValue;
+      }
+    }
+}
 
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::SetupConnectivity()
+{
+  if ((m_SetupForegroundCellConnectivity == m_ForegroundCellConnectivity) &&
+      (m_SetupBackgroundCellConnectivity == m_BackgroundCellConnectivity))
+    {
+    // kept from the last update
+    return;
+    }
+  m_SetupForegroundCellConnectivity = m_ForegroundCellConnectivity;
+  m_SetupBackgroundCellConnectivity = m_BackgroundCellConnectivity;
+
+  // the adjacency of the positions of the cube, and the positions
+  // around the centre, under the two connectivities
+  m_FGConnect.Initialize(m_ForegroundCellConnectivity,
+			 genNeigCon(m_ForegroundCellConnectivity));
+  m_BGConnect.Initialize(m_BackgroundCellConnectivity,
+			 genNeigCon(m_BackgroundCellConnectivity));
+  CentInd = ConnectivityTableType::Centre;
+
+  // the same structures as bit masks, if the cube fits in one
+  const unsigned SZ = ConnectivityTableType::Size;
+  m_UseBitMasks = (SZ <= sizeof(NeighborhoodCodeType) * CHAR_BIT);
+  if (m_UseBitMasks)
+    {
+    m_FGConnectMasks.assign(SZ, 0);
+    m_BGConnectMasks.assign(SZ, 0);
+    m_FGConnectivityMask = 0;
+    m_BGConnectivityMask = 0;
+    m_FGNeighConnectivityMask = 0;
+    m_BGNeighConnectivityMask = 0;
+    m_CubeMask = 0;
+    for (unsigned pos = 0; pos < SZ; pos++)
+      {
+      const NeighborhoodCodeType bit = NeighborhoodCodeType(1) << pos;
+      for (unsigned K = 0; K < m_FGConnect.GetNumberOfNeighbors(pos); K++)
+	{
+	m_FGConnectMasks[pos] |= NeighborhoodCodeType(1) << m_FGConnect.GetNeighbors(pos)[K];
+	}
+      for (unsigned K = 0; K < m_BGConnect.GetNumberOfNeighbors(pos); K++)
+	{
+	m_BGConnectMasks[pos] |= NeighborhoodCodeType(1) << m_BGConnect.GetNeighbors(pos)[K];
+	}
+      if (m_FGConnect.GetConnectivityTest(pos)) m_FGConnectivityMask |= bit;
+      if (m_BGConnect.GetConnectivityTest(pos)) m_BGConnectivityMask |= bit;
+      if (m_FGConnect.GetNeighConnectivityTest(pos)) m_FGNeighConnectivityMask |= bit;
+      if (m_BGConnect.GetNeighConnectivityTest(pos)) m_BGNeighConnectivityMask |= bit;
+      m_CubeMask |= bit;
+      }
+    }
 }
 
 template<class TOrderImage, class TImage>
@@ -399,14 +1320,23 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 #endif
 
 
+  return EvaluateCube(cubeBuffer);
+}
+
+template<class TOrderImage, class TImage>
+bool 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::EvaluateCube(bool *cubeBuffer)
+{
   // count the neighbors of the centre position to determine
   // terminality
   unsigned int ncount = 0;
 
-  for (unsigned i = 0; i < m_FGConnect[CentInd].size(); i++)
+  const typename ConnectivityTableType::PositionType *centreNeighbors =
+    m_FGConnect.GetNeighbors(CentInd);
+  for (unsigned i = 0; i < m_FGConnect.GetNumberOfNeighbors(CentInd); i++)
     {
-    unsigned idx = m_FGConnect[CentInd][i];
-    if (cubeBuffer[idx])
+    if (cubeBuffer[centreNeighbors[i]])
       ++ncount;
     }
 
@@ -426,14 +1356,12 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 
   // now to count connected components
   // foreground
-  unsigned SZ = m_FGConnect.size();
+  const unsigned SZ = ConnectivityTableType::Size;
   
   // remove the centre point
   cubeBuffer[CentInd] = false;
  
-  int fgCC = countCC(cubeBuffer, m_FGConnect,
-		     m_FGConnectivityTest,
-		     m_FGNeighConnectivityTest);
+  int fgCC = countCC(cubeBuffer, m_FGConnect);
   
 #ifdef SKEL_DEBUG
   std::cout << "fgCC " << fgCC << std::endl;
@@ -443,7 +1371,6 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 
   // background this time
   
-  SZ = m_BGConnect.size();
   // invert cube
   for (unsigned J = 0; J < SZ; J++)
     {
@@ -452,9 +1379,7 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
   cubeBuffer[CentInd] = false;
 
 
-  int bgCC = countCC(cubeBuffer, m_BGConnect,
-		     m_BGConnectivityTest,
-		     m_BGNeighConnectivityTest);
+  int bgCC = countCC(cubeBuffer, m_BGConnect);
   
 #ifdef SKEL_DEBUG
   std::cout << "bgCC " << bgCC << std::endl;
@@ -466,19 +1391,247 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 }
 
 
+template<class TOrderImage, class TImage>
+bool 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::IsRemovable(NeighborhoodCodeType cube)
+{
+  if (m_SimplePointTableActive)
+    {
+    return LookupSimplePoint(CubeToCode(cube));
+    }
+  return EvaluateCube(cube);
+}
+
+template<class TOrderImage, class TImage>
+bool 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::IsRemovable(NeighborhoodCodeType cube, MaskVecType &misses) const
+{
+  if (!m_SimplePointTableActive)
+    {
+    return EvaluateCube(cube);
+    }
+  const NeighborhoodCodeType code = CubeToCode(cube);
+  const unsigned char E = (m_SimplePointTable[code >> 2] >> ((code & 3) << 1)) & 3;
+  if (E & 1)
+    {
+    return (E & 2);
+    }
+  const bool removable = EvaluateCube(cube);
+  misses.push_back((code << 1) | removable);
+  return removable;
+}
+
+template<class TOrderImage, class TImage>
+bool 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::EvaluateCube(NeighborhoodCodeType cube) const
+{
+  // same test as EvaluateCube(bool *), see there for details
+  if (BitCount(cube & m_FGConnectivityMask) == 1)
+    {
+    // terminal point
+    return(false);
+    }
+
+  const NeighborhoodCodeType centre = NeighborhoodCodeType(1) << CentInd;
+  cube &= ~centre;
+
+  int fgCC = countCC(cube, m_FGConnectMasks,
+		     m_FGConnectivityMask,
+		     m_FGNeighConnectivityMask);
+  if (fgCC != 1) return (false);
+
+  int bgCC = countCC(~cube & m_CubeMask & ~centre, m_BGConnectMasks,
+		     m_BGConnectivityMask,
+		     m_BGNeighConnectivityMask);
+  if (bgCC != 1) return(false);
+
+  return(true);
+}
+
+template<class TOrderImage, class TImage>
+int
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::countCC(NeighborhoodCodeType cube,
+	  const MaskVecType &ConnectMasks,
+	  NeighborhoodCodeType ConnectivityTest,
+	  NeighborhoodCodeType NeighConnectivityTest) const
+{
+  // the mask version of countCC(bool[], ...). Each component is
+  // grown from the lowest remaining seed, and only voxels passing the
+  // neighborhood connectivity test are used to grow it.
+  NeighborhoodCodeType seeds = cube & ConnectivityTest;
+  int nbCC = 0;
+
+  while (seeds)
+    {
+    ++nbCC;
+    NeighborhoodCodeType component = seeds & (~seeds + 1);
+    NeighborhoodCodeType front = component & NeighConnectivityTest;
+    while (front)
+      {
+      const unsigned current = LowestBit(front);
+      front &= front - 1;
+      const NeighborhoodCodeType added = ConnectMasks[current] & cube & ~component;
+      component |= added;
+      front |= added & NeighConnectivityTest;
+      }
+    seeds &= ~component;
+    }
+  return nbCC;
+}
+
+#ifdef SKEL_INSTRUMENT
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::CountRejection(NeighborhoodCodeType cube, ThinningCounters &counters) const
+{
+  // the tests of EvaluateCube(NeighborhoodCodeType), in the same order
+  if (BitCount(cube & m_FGConnectivityMask) == 1)
+    {
+    ++counters.TerminalRejections;
+    return;
+    }
+  cube &= ~(NeighborhoodCodeType(1) << CentInd);
+  if (countCC(cube, m_FGConnectMasks, m_FGConnectivityMask,
+	      m_FGNeighConnectivityMask) != 1)
+    {
+    ++counters.ForegroundRejections;
+    return;
+    }
+  ++counters.BackgroundRejections;
+}
+
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::CountRejection(bool *cubeBuffer, ThinningCounters &counters)
+{
+  // the tests of EvaluateCube(bool *), in the same order
+  unsigned int ncount = 0;
+  for (unsigned i = 0; i < m_FGConnect.GetNumberOfNeighbors(CentInd); i++)
+    {
+    ncount += cubeBuffer[m_FGConnect.GetNeighbors(CentInd)[i]];
+    }
+  if (ncount == 1)
+    {
+    ++counters.TerminalRejections;
+    return;
+    }
+  cubeBuffer[CentInd] = false;
+  if (countCC(cubeBuffer, m_FGConnect) != 1)
+    {
+    ++counters.ForegroundRejections;
+    return;
+    }
+  ++counters.BackgroundRejections;
+}
+
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::StoreCounters(const ThinningCounters &counters)
+{
+  m_NumberOfQueuePops = counters.Pops;
+  m_NumberOfRequeues = counters.Requeues;
+  m_NumberOfRemovals = counters.Removals;
+  m_NumberOfTerminalRejections = counters.TerminalRejections;
+  m_NumberOfForegroundRejections = counters.ForegroundRejections;
+  m_NumberOfBackgroundRejections = counters.BackgroundRejections;
+  m_MaximumQueueSize = counters.MaximumQueueSize;
+}
+#endif
+
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::SetupSimplePointTable()
+{
+  // the answer of EvaluateCube only depends on the neighbors of the
+  // centre, so it can be tabulated by a code with one bit per
+  // neighbor. That is only practical up to 3D (26 neighbors).
+  const unsigned cubeSize = ConnectivityTableType::Size;
+  if (!m_UseSimplePointTable || !m_UseBitMasks || cubeSize - 1 > 26)
+    {
+    m_SimplePointTableActive = false;
+    return;
+    }
+  m_SimplePointTableActive = true;
+
+  // the min keeps the shift in range for the larger cubes, that
+  // returned above
+  const unsigned long entries = 1UL << std::min(cubeSize - 1, 26U);
+  const unsigned long bytes = (entries + 3) / 4;
+  if ((m_TableForegroundCellConnectivity == m_ForegroundCellConnectivity) &&
+      (m_TableBackgroundCellConnectivity == m_BackgroundCellConnectivity) &&
+      (m_SimplePointTable.size() == bytes))
+    {
+    // still valid from the previous update
+    return;
+    }
+
+  m_SimplePointTable.assign(bytes, 0);
+  m_TableForegroundCellConnectivity = m_ForegroundCellConnectivity;
+  m_TableBackgroundCellConnectivity = m_BackgroundCellConnectivity;
+
+  if (OrderingImageType::ImageDimension <= 2)
+    {
+    // small enough to fill completely now. 3D tables are filled as
+    // configurations are encountered
+    for (unsigned long code = 0; code < entries; code++)
+      {
+      LookupSimplePoint(code);
+      }
+    }
+}
+
+template<class TOrderImage, class TImage>
+bool 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::LookupSimplePoint(NeighborhoodCodeType code)
+{
+  unsigned char &entry = m_SimplePointTable[code >> 2];
+  const unsigned shift = (code & 3) << 1;
+  const unsigned char E = (entry >> shift) & 3;
+  if (E & 1)
+    {
+    return (E & 2);
+    }
+
+  // not seen before - put the centre back and run the test
+  const NeighborhoodCodeType low = (NeighborhoodCodeType(1) << CentInd) - 1;
+  const NeighborhoodCodeType cube = (code & low) |
+    ((code >> CentInd) << (CentInd + 1)) | (low + 1);
+  const bool removable = EvaluateCube(cube);
+  entry |= (1 | (removable << 1)) << shift;
+  return removable;
+}
+
+template<class TOrderImage, class TImage>
+void 
+SkeletonizeBaseImageFilter<TOrderImage, TImage>
+::StoreSimplePoints(const MaskVecType &misses)
+{
+  // entries are the code shifted by one, with the answer in the
+  // lowest bit
+  for (unsigned long i = 0; i < misses.size(); i++)
+    {
+    const NeighborhoodCodeType code = misses[i] >> 1;
+    m_SimplePointTable[code >> 2] |= (1 | ((misses[i] & 1) << 1)) << ((code & 3) << 1);
+    }
+}
+
 template<class TOrderImage, class TImage>
 int
 SkeletonizeBaseImageFilter<TOrderImage, TImage>
-::countCC(bool cubeBuffer[],
-	  const OffsetImType &ConnectIm,
-	  const std::vector<bool> &ConnectivityTest,
-	  const std::vector<bool> &NeighConnectivityTest)
+::countCC(bool cubeBuffer[], const ConnectivityTableType &table)
 
 {
-  // searching for first seed
-  unsigned SZ = ConnectIm.size();
-  // need to change this if we use while loops to find the first seed
-  unsigned seed = SZ;
+  typedef typename ConnectivityTableType::PositionType PositionType;
+  const unsigned SZ = ConnectivityTableType::Size;
 #ifdef SKEL_DEBUG
   std::cout << "Counter ";
   for (unsigned pos = 0; pos < SZ; pos++)
@@ -488,75 +1641,45 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
   std::cout << std::endl;
 #endif
 
-  // set seed to max in case we don't find any start point
-  for (unsigned J = 0; J < SZ; J++)
-     {
-     if (cubeBuffer[J] && ConnectivityTest[J])
-       {
-       seed = J;
-       break;
-       }
-     }
-  
-//    while ((seed != SZ) &&
-//  	 ((cubeBuffer[seed] == 0) || !ConnectivityTest[seed]))
-//      {
-//      ++seed;
-//      }
-#ifdef SKEL_DEBUG
-   std::cout << "seed " << seed << std::endl;
-#endif
-  // now label connected components
-  std::vector<bool> processed(SZ, false);
-  int nbCC = 0;
+  // each position is queued at most once, so the queue is a plain
+  // array
+  bool processed[ConnectivityTableType::Size];
+  PositionType q[ConnectivityTableType::Size];
+  std::fill(processed, processed + SZ, false);
 
-  while (seed != SZ)
+  int nbCC = 0;
+  for (unsigned seed = 0; seed < SZ; seed++)
     {
+    if (processed[seed] || !cubeBuffer[seed] || !table.GetConnectivityTest(seed))
+      {
+      continue;
+      }
+#ifdef SKEL_DEBUG
+    std::cout << "seed " << seed << std::endl;
+#endif
+    // now label connected components
     ++nbCC;
     processed[seed] = true;
-
-    std::queue<unsigned int, std::list<unsigned int> > q;
-    q.push(seed);
-    
-    while(!q.empty())
+    unsigned head = 0, tail = 0;
+    q[tail++] = seed;
+    while (head != tail)
       {
-      unsigned int const current = q.front();
-      q.pop();
-      
-      if (NeighConnectivityTest[current])
+      const unsigned current = q[head++];
+      if (table.GetNeighConnectivityTest(current))
 	{
-	for(unsigned int nn = 0; nn < ConnectIm[current].size(); ++nn)
+	const PositionType *neighbors = table.GetNeighbors(current);
+	const unsigned count = table.GetNumberOfNeighbors(current);
+	for (unsigned nn = 0; nn < count; ++nn)
 	  {
-	  unsigned int neighbor = ConnectIm[current][nn];
-	  if(!processed[neighbor] && (cubeBuffer[neighbor]))
+	  const unsigned neighbor = neighbors[nn];
+	  if (!processed[neighbor] && cubeBuffer[neighbor])
 	    {
-	    q.push(neighbor);
+	    q[tail++] = neighbor;
 	    processed[neighbor] = true;
 	    }
 	  }
 	}
       }
-    // Look for next seed
-//     while(seed != SZ && 
-
-//           ( processed[seed] || (cubeBuffer[seed] == 0) || !ConnectivityTest[seed] ) 
-
-//          )
-//       {
-//       ++seed;
-//       }
-
-    for (;
-	 (seed < SZ) && ( processed[seed] || !cubeBuffer[seed] || !ConnectivityTest[seed] ) ;
-	 ++seed);
-
-
-//     for (;seed < SZ; ++seed)
-//       {
-//       if (!processed[seed] && cubeBuffer[seed] && ConnectivityTest[seed] )
-// 	break;
-//       }
-
     }
    
   return nbCC;
@@ -567,7 +1690,7 @@ SkeletonizeBaseImageFilter<TOrderImage, TImage>
 template<class TOrderImage, class TImage>
 unsigned 
 SkeletonizeBaseImageFilter<TOrderImage, TImage>
-::genNeigCon(unsigned CellConnect)
+::genNeigCon(unsigned CellConnect) const
 {
   // return the neighborhood connectivity corresponding to a cell
   // connectivity - hard coded for 2 and 3 dimensions
@@ -2,6 +2,7 @@
 #define __itkSkeletonizeImageFilter_h
 
 #include "itkImageToImageFilter.h"
+#include "itkProgressAccumulator.h"
 
 namespace itk {
 /** \class SkeletonizeImageFilter
@@ -9,11 +10,16 @@ namespace itk {
  *  to skeletonize a mask
  *
  *  This is a convenience filter that skeletonizes a mask. Internally
- *  it uses the DanielssonDistanceTransformImageFilter with floating
- *  point pixel types. The distance transform step can dominate the
- *  computation time, so don't use this filter if you've computed the
- *  distance transform for other reasons or don't want this level of
- *  precision.
+ *  it computes a distance transform of the mask and uses it as the
+ *  ordering of SkeletonizeBaseImageFilter. The distance transform
+ *  step can dominate the computation time, so don't use this filter
+ *  if you've computed the distance transform for other reasons.
+ *
+ *  The distance transform is selected with SetDistanceTransform:
+ *  Danielsson (the default) is the DanielssonDistanceMapImageFilter,
+ *  SeparableEuclidean is an exact euclidean map computed in linear
+ *  time on several threads and Chamfer is a cheaper integer
+ *  approximation.
  *
  * \author Richard Beare
  */
@@ -35,6 +41,13 @@ public :
 
   typedef typename TImage::PixelType InputPixelType;
   typedef typename TOutImage::PixelType OutputPixelType;
+
+  /** the distance transforms that can be used for the ordering */
+  typedef enum {
+    Danielsson,
+    SeparableEuclidean,
+    Chamfer
+  } DistanceTransformType;
 		  
   /** Set/Get the foreground value. Defaults to max */
   itkSetMacro(ForegroundValue, OutputPixelType);
@@ -49,6 +62,61 @@ public :
 
   itkSetMacro(BackgroundCellConnectivity, unsigned);
   itkGetMacro(BackgroundCellConnectivity, unsigned);
+
+  /** Set/Get whether the thinning runs on several threads. See
+   * SkeletonizeBaseImageFilter::SetParallelThinning */
+  itkSetMacro(ParallelThinning, bool);
+  itkGetConstReferenceMacro(ParallelThinning, bool);
+  itkBooleanMacro(ParallelThinning);
+
+  /** Set/Get the band of distances thinned together by the parallel
+   * thinning, in physical units. Defaults to 0 */
+  itkSetMacro(ParallelLevelWidth, float);
+  itkGetMacro(ParallelLevelWidth, float);
+
+  /** Set/Get whether the objects of the mask are thinned separately
+   * on several threads. See
+   * SkeletonizeBaseImageFilter::SetParallelComponentThinning */
+  itkSetMacro(ParallelComponentThinning, bool);
+  itkGetConstReferenceMacro(ParallelComponentThinning, bool);
+  itkBooleanMacro(ParallelComponentThinning);
+
+  /** Set/Get whether the distances are quantized before the
+   * thinning. See SkeletonizeBaseImageFilter::SetQuantizeOrdering -
+   * the skeleton may move by a voxel where the distance varies by
+   * less than the quantum. Has no effect with the Chamfer distance
+   * transform, which is already made of small integers. Defaults to
+   * false */
+  itkSetMacro(QuantizeOrdering, bool);
+  itkGetConstReferenceMacro(QuantizeOrdering, bool);
+  itkBooleanMacro(QuantizeOrdering);
+
+  /** Set/Get the width of a level of the quantized distances, in
+   * physical units. Defaults to 0 - the range of the distances split
+   * into 65535 levels */
+  itkSetMacro(OrderingQuantum, double);
+  itkGetConstMacro(OrderingQuantum, double);
+
+  /** Set/Get the distance transform. Defaults to Danielsson */
+  itkSetMacro(DistanceTransform, DistanceTransformType);
+  itkGetConstMacro(DistanceTransform, DistanceTransformType);
+
+  /** Set/Get the anchor image, an optional second input: the voxels
+   * of the mask that are non zero in it are kept in the
+   * skeleton. See SkeletonizeBaseImageFilter::SetAnchorImage */
+  typedef TOutImage AnchorImageType;
+  void SetAnchorImage(const AnchorImageType *anchors)
+    {
+    this->SetNthInput(1, const_cast<AnchorImageType *>(anchors));
+    }
+  const AnchorImageType * GetAnchorImage() const
+    {
+    return static_cast<const AnchorImageType *>(this->ProcessObject::GetInput(1));
+    }
+
+  /** Get the number of voxels pushed into the priority queue by the
+   * last thinning. See SkeletonizeBaseImageFilter */
+  itkGetConstMacro(NumberOfQueuePushes, unsigned long);
 		
 protected:
   SkeletonizeImageFilter();
@@ -59,13 +127,24 @@ protected:
   void GenerateData();
   void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
 
+  // thins the mask in the ordering given by the distance filter
+  template <class TDistanceFilter>
+  void ThinWithDistance(TDistanceFilter *disttrans, float levelScale,
+			ProgressAccumulator *progress);
+
   InputPixelType m_ForegroundValue;
   //OutputPixelType m_BackgroundValue;
 
   unsigned m_ForegroundCellConnectivity;
   unsigned m_BackgroundCellConnectivity;
 
-
+  bool m_ParallelThinning;
+  float m_ParallelLevelWidth;
+  bool m_ParallelComponentThinning;
+  DistanceTransformType m_DistanceTransform;
+  bool m_QuantizeOrdering;
+  double m_OrderingQuantum;
+  unsigned long m_NumberOfQueuePushes;
 
 };
 } // namespace itk
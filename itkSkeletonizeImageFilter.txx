@@ -1,11 +1,13 @@
 #ifndef __itkSkeletonizeImageFilter_txx
 #define __itkSkeletonizeImageFilter_txx
 
-#include "itkImageFileWriter.h"
 #include "itkSkeletonizeImageFilter.h"
 #include "itkDanielssonDistanceMapImageFilter.h"
+#include "itkSeparableDistanceMapImageFilter.h"
+#include "itkChamferDistanceMapImageFilter.h"
 #include "itkSkeletonizeBaseImageFilter.h"
 #include "itkBinaryThresholdImageFilter.h"
+#include <algorithm>
 
 namespace itk
 {
@@ -22,7 +24,13 @@ SkeletonizeImageFilter<TImage, TOutImage>
 
   this->SetForegroundCellConnectivity(0);
   this->SetBackgroundCellConnectivity(TImage::ImageDimension - 1);
-
+  m_ParallelThinning = false;
+  m_ParallelLevelWidth = 0;
+  m_ParallelComponentThinning = false;
+  m_DistanceTransform = Danielsson;
+  m_QuantizeOrdering = false;
+  m_OrderingQuantum = 0;
+  m_NumberOfQueuePushes = 0;
 }
 
 template <class TImage, class TOutImage>
@@ -39,6 +47,11 @@ SkeletonizeImageFilter<TImage, TOutImage>
     { return; }
   input->SetRequestedRegion( input->GetLargestPossibleRegion() );
 
+  AnchorImageType * anchors = const_cast<AnchorImageType *>(this->GetAnchorImage());
+  if ( anchors )
+    {
+    anchors->SetRequestedRegion( anchors->GetLargestPossibleRegion() );
+    }
 }
 
 template <class TImage, class TOutImage>
@@ -63,46 +76,93 @@ SkeletonizeImageFilter<TImage, TOutImage>
   this->AllocateOutputs();
 
   typedef typename itk::Image< float, TImage::ImageDimension > DistType;
+  // chamfer distances are small integers
+  typedef typename itk::Image< unsigned short, TImage::ImageDimension > ChamferType;
+
+  switch (m_DistanceTransform)
+    {
+    case Danielsson:
+      {
+      typedef typename itk::DanielssonDistanceMapImageFilter<TImage, DistType> DTType;
+      typename DTType::Pointer disttrans = DTType::New();
+      disttrans->SetUseImageSpacing(true);
+      this->ThinWithDistance(disttrans.GetPointer(), 1.0, progress);
+      break;
+      }
+    case Chamfer:
+      {
+      typedef typename itk::ChamferDistanceMapImageFilter<TImage, ChamferType> DTType;
+      typename DTType::Pointer disttrans = DTType::New();
+      disttrans->SetUseImageSpacing(true);
+      // the shortest step costs 3
+      double smallest = this->GetInput()->GetSpacing()[0];
+      for (unsigned d = 1; d < TImage::ImageDimension; d++)
+	{
+	smallest = std::min(smallest, (double)this->GetInput()->GetSpacing()[d]);
+	}
+      this->ThinWithDistance(disttrans.GetPointer(), 3.0 / smallest, progress);
+      break;
+      }
+    default:
+      {
+      typedef typename itk::SeparableDistanceMapImageFilter<TImage, DistType> DTType;
+      typename DTType::Pointer disttrans = DTType::New();
+      disttrans->SetUseImageSpacing(true);
+      disttrans->SetNumberOfThreads(this->GetNumberOfThreads());
+      this->ThinWithDistance(disttrans.GetPointer(), 1.0, progress);
+      break;
+      }
+    }
+}
 
+template <class TImage, class TOutImage>
+template <class TDistanceFilter>
+void
+SkeletonizeImageFilter<TImage, TOutImage>
+::ThinWithDistance(TDistanceFilter *disttrans, float levelScale,
+		   ProgressAccumulator *progress)
+{
+  typedef typename TDistanceFilter::OutputImageType DistType;
   typedef typename itk::BinaryThresholdImageFilter<TImage, TImage> ThreshType;
-  typedef typename itk::DanielssonDistanceMapImageFilter<TImage, DistType> DTType;
   typedef typename itk::SkeletonizeBaseImageFilter<DistType, TOutImage> SkelType;
 
   typename ThreshType::Pointer thresh = ThreshType::New();
-  typename DTType::Pointer disttrans = DTType::New();
   typename SkelType::Pointer skel = SkelType::New();
 
   progress->RegisterInternalFilter(thresh, 0.1f);
   progress->RegisterInternalFilter(disttrans, 0.6f);
   progress->RegisterInternalFilter(skel, 0.3f);
 
-  // threshold filter needs to select the foreground voxels
+  // threshold filter needs to select the foreground voxels. Danielsson
+  // computes the distance to the non zero voxels, the others the
+  // distance of the non zero voxels to the zero ones
+  const bool insideIsZero = (m_DistanceTransform == Danielsson);
   thresh->SetInput(this->GetInput());
   thresh->SetLowerThreshold(m_ForegroundValue);
   thresh->SetUpperThreshold(m_ForegroundValue);
-  thresh->SetInsideValue(0);
-  thresh->SetOutsideValue(1);
+  thresh->SetInsideValue(insideIsZero ? 0 : 1);
+  thresh->SetOutsideValue(insideIsZero ? 1 : 0);
 
   disttrans->SetInput(thresh->GetOutput());
-  disttrans->SetUseImageSpacing(true);
-  
-  typedef typename itk::ImageFileWriter<DistType> WType;
-  typename WType::Pointer wr = WType::New();
-  wr->SetInput(disttrans->GetOutput());
-  wr->SetFileName("dt.nii.gz");
-  wr->Update();
-  std::cout << "Finished DT" << std::endl;
 
   skel->SetInput(disttrans->GetOutput());
+  skel->SetAnchorImage(this->GetAnchorImage());
   skel->SetForegroundValue(1);
   skel->SetBackgroundValue(0);
   skel->SetForegroundCellConnectivity(m_ForegroundCellConnectivity);
   skel->SetBackgroundCellConnectivity(m_BackgroundCellConnectivity);
+  skel->SetParallelThinning(m_ParallelThinning);
+  skel->SetParallelLevelWidth(
+    static_cast<typename DistType::PixelType>(m_ParallelLevelWidth * levelScale));
+  skel->SetParallelComponentThinning(m_ParallelComponentThinning);
+  skel->SetQuantizeOrdering(m_QuantizeOrdering);
+  skel->SetOrderingQuantum(m_OrderingQuantum * levelScale);
+  skel->SetNumberOfThreads(this->GetNumberOfThreads());
   skel->GraftOutput(this->GetOutput());
   skel->Update();
+  m_NumberOfQueuePushes = skel->GetNumberOfQueuePushes();
   this->GraftOutput(skel->GetOutput());
 }
 
-
 }
 #endif
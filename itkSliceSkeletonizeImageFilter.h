@@ -0,0 +1,147 @@
+#ifndef __itkSliceSkeletonizeImageFilter_h
+#define __itkSliceSkeletonizeImageFilter_h
+
+#include <vector>
+#include "itkImageToImageFilter.h"
+#include "itkMultiThreader.h"
+#include "itkSkeletonizeBaseImageFilter.h"
+
+namespace itk {
+/** \class SliceSkeletonizeImageFilter
+ *  \brief Skeletonizes each slice of a mask independently
+ *
+ *  The slices normal to SliceDirection (the last dimension by
+ *  default, the sections of a 3D stack) are skeletonized as images
+ *  of one dimension less, as SkeletonizeImageFilter would with the
+ *  SeparableEuclidean distance transform. The result is the same as
+ *  extracting each slice, skeletonizing it and pasting it back, but
+ *  without the extract and paste filters.
+ *
+ *  The slices are shared between the threads (see
+ *  SetNumberOfThreads). Each thread computes the distance transform
+ *  of its slices straight from the input with SquaredDistanceLine,
+ *  and thins them with its own SkeletonizeBaseImageFilter through
+ *  ProcessImage, so the tables and queues of the thinning are set up
+ *  once per thread, and the queues freed at the end. When the slices
+ *  are normal to the last dimension they are contiguous in the
+ *  output, and are thinned in place. The slices without foreground
+ *  are left empty without thinning.
+ *
+ *  The connectivities are those of the slices: 0 to
+ *  ImageDimension - 2.
+ *
+ * \author Richard Beare
+ */
+template <class TImage, class TOutImage=TImage>
+class ITK_EXPORT SliceSkeletonizeImageFilter : public ImageToImageFilter<TImage, TOutImage>
+{
+public :
+  // standard ITK type definitions
+  typedef SliceSkeletonizeImageFilter Self;
+  typedef ImageToImageFilter<TImage, TOutImage> Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<Self const> ConstPointer;
+
+  itkNewMacro(Self);
+  itkTypeMacro(SliceSkeletonizeImageFilter, ImageToImageFilter);
+
+  typedef TImage InputImageType;
+  typedef TOutImage OutputImageType;
+  typedef typename TImage::Pointer InputImagePointer;
+
+  typedef typename TImage::PixelType InputPixelType;
+  typedef typename TOutImage::PixelType OutputPixelType;
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TImage::ImageDimension);
+  itkStaticConstMacro(SliceDimension, unsigned int, TImage::ImageDimension - 1);
+
+  /** the slices and the thinning of each of them */
+  typedef Image<float, itkGetStaticConstMacro(SliceDimension)> SliceOrderingImageType;
+  typedef Image<OutputPixelType, itkGetStaticConstMacro(SliceDimension)> SliceOutputImageType;
+  typedef SkeletonizeBaseImageFilter<SliceOrderingImageType, SliceOutputImageType> SliceSkeletonizeType;
+
+  /** Set/Get the foreground value. Defaults to 1 */
+  itkSetMacro(ForegroundValue, InputPixelType);
+  itkGetMacro(ForegroundValue, InputPixelType);
+
+  itkSetMacro(ForegroundCellConnectivity, unsigned);
+  itkGetMacro(ForegroundCellConnectivity, unsigned);
+
+  itkSetMacro(BackgroundCellConnectivity, unsigned);
+  itkGetMacro(BackgroundCellConnectivity, unsigned);
+
+  /** Set/Get the dimension normal to the slices. Defaults to the
+   * last one */
+  itkSetMacro(SliceDirection, unsigned);
+  itkGetMacro(SliceDirection, unsigned);
+
+  /** Set/Get whether the distances are physical distances or
+   * numbers of voxels. Defaults to true */
+  itkSetMacro(UseImageSpacing, bool);
+  itkGetConstReferenceMacro(UseImageSpacing, bool);
+  itkBooleanMacro(UseImageSpacing);
+
+protected:
+  SliceSkeletonizeImageFilter();
+  virtual ~SliceSkeletonizeImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  void GenerateInputRequestedRegion();
+  void GenerateData();
+  void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
+
+private:
+  SliceSkeletonizeImageFilter(Self const &); // Purposedly not implemented
+  void operator=(Self const &); // Purposedly not implemented
+
+  // what a thread needs to skeletonize its slices, kept between runs
+  struct SliceWorker
+  {
+    typename SliceSkeletonizeType::Pointer Thinner;
+    typename SliceOrderingImageType::Pointer Ordering;
+    typename SliceOutputImageType::Pointer Output;
+    std::vector<double> Squared;
+    std::vector<double> Line;
+    std::vector<double> Result;
+    std::vector<double> Z;
+    std::vector<unsigned long> V;
+  };
+
+  struct SliceThreadStruct
+  {
+    Self * Filter;
+  };
+  static ITK_THREAD_RETURN_TYPE SliceThreaderCallback(void *arg);
+
+  // skeletonizes the slices threadId, threadId + threadCount...
+  void ThreadedSlices(unsigned threadId, unsigned threadCount);
+
+  // the distance transform of a slice in the worker's ordering
+  // image. Returns false if the slice has no foreground
+  bool SliceDistance(unsigned long slice, SliceWorker &worker);
+
+  InputPixelType m_ForegroundValue;
+  unsigned m_ForegroundCellConnectivity;
+  unsigned m_BackgroundCellConnectivity;
+  unsigned m_SliceDirection;
+  bool m_UseImageSpacing;
+
+  // the dimensions of the slices, in order, and the layout of the
+  // input and output buffers
+  unsigned m_InPlane[itkGetStaticConstMacro(SliceDimension)];
+  unsigned long m_Size[itkGetStaticConstMacro(ImageDimension)];
+  unsigned long m_InputStrides[itkGetStaticConstMacro(ImageDimension)];
+  unsigned long m_OutputStrides[itkGetStaticConstMacro(ImageDimension)];
+  double m_Spacing[itkGetStaticConstMacro(ImageDimension)];
+  const InputPixelType * m_InputStart;
+  OutputPixelType * m_OutputStart;
+
+  std::vector<SliceWorker> m_Workers;
+};
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSliceSkeletonizeImageFilter.txx"
+#endif
+
+#endif
@@ -0,0 +1,340 @@
+#ifndef __itkSliceSkeletonizeImageFilter_txx
+#define __itkSliceSkeletonizeImageFilter_txx
+
+#include <cmath>
+#include <algorithm>
+#include "itkSliceSkeletonizeImageFilter.h"
+#include "itkDistanceMapKernels.h"
+#include "itkProgressReporter.h"
+
+namespace itk
+{
+
+template <class TImage, class TOutImage>
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::SliceSkeletonizeImageFilter()
+{
+  m_ForegroundValue = 1;
+  // the defaults of SkeletonizeImageFilter, for the slices
+  m_ForegroundCellConnectivity = 0;
+  m_BackgroundCellConnectivity = SliceDimension - 1;
+  m_SliceDirection = ImageDimension - 1;
+  m_UseImageSpacing = true;
+  m_InputStart = 0;
+  m_OutputStart = 0;
+}
+
+template <class TImage, class TOutImage>
+void
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::GenerateInputRequestedRegion()
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+
+  // We need all the input.
+  InputImagePointer input = const_cast<InputImageType *>(this->GetInput());
+  if ( !input )
+    { return; }
+  input->SetRequestedRegion( input->GetLargestPossibleRegion() );
+}
+
+template <class TImage, class TOutImage>
+void
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::EnlargeOutputRequestedRegion(DataObject *)
+{
+  this->GetOutput()
+    ->SetRequestedRegion( this->GetOutput()->GetLargestPossibleRegion() );
+}
+
+template <class TImage, class TOutImage>
+void
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::GenerateData()
+{
+  if (m_SliceDirection >= ImageDimension)
+    {
+    itkExceptionMacro(<< "SliceDirection " << m_SliceDirection
+		      << " is not a dimension of the image");
+    }
+
+  this->AllocateOutputs();
+  const InputImageType * input = this->GetInput();
+  OutputImageType * output = this->GetOutput();
+  const typename OutputImageType::RegionType region = output->GetRequestedRegion();
+
+  // the buffers are walked directly, from the first voxel of the region
+  for (unsigned d = 0, k = 0; d < ImageDimension; d++)
+    {
+    m_Size[d] = region.GetSize()[d];
+    m_InputStrides[d] = input->GetOffsetTable()[d];
+    m_OutputStrides[d] = output->GetOffsetTable()[d];
+    m_Spacing[d] = m_UseImageSpacing ? input->GetSpacing()[d] : 1.0;
+    if (d != m_SliceDirection)
+      {
+      m_InPlane[k++] = d;
+      }
+    }
+  m_InputStart = input->GetBufferPointer() + input->ComputeOffset(region.GetIndex());
+  m_OutputStart = output->GetBufferPointer() + output->ComputeOffset(region.GetIndex());
+
+  const unsigned long slices = m_Size[m_SliceDirection];
+  if (slices == 0)
+    {
+    return;
+    }
+
+  // a worker per thread, and no more threads than slices. The workers
+  // of the previous runs are reused
+  unsigned threads = this->GetNumberOfThreads();
+  if (threads > slices)
+    {
+    threads = slices;
+    }
+  if (m_Workers.size() < threads)
+    {
+    m_Workers.resize(threads);
+    }
+
+  typename SliceOrderingImageType::RegionType sliceRegion;
+  typename SliceOrderingImageType::SpacingType sliceSpacing;
+  typename SliceOrderingImageType::PointType sliceOrigin;
+  for (unsigned k = 0; k < SliceDimension; k++)
+    {
+    sliceRegion.SetIndex(k, 0);
+    sliceRegion.SetSize(k, m_Size[m_InPlane[k]]);
+    sliceSpacing[k] = input->GetSpacing()[m_InPlane[k]];
+    sliceOrigin[k] = input->GetOrigin()[m_InPlane[k]];
+    }
+  for (unsigned t = 0; t < threads; t++)
+    {
+    SliceWorker &worker = m_Workers[t];
+    if (worker.Thinner.IsNull())
+      {
+      worker.Thinner = SliceSkeletonizeType::New();
+      worker.Ordering = SliceOrderingImageType::New();
+      worker.Output = SliceOutputImageType::New();
+      }
+    // the threads are taken by the slices
+    worker.Thinner->SetNumberOfThreads(1);
+    worker.Thinner->SetForegroundValue(1);
+    worker.Thinner->SetBackgroundValue(0);
+    worker.Thinner->SetForegroundCellConnectivity(m_ForegroundCellConnectivity);
+    worker.Thinner->SetBackgroundCellConnectivity(m_BackgroundCellConnectivity);
+    // Allocate only reallocates when the buffer is too small
+    worker.Ordering->SetRegions(sliceRegion);
+    worker.Ordering->SetSpacing(sliceSpacing);
+    worker.Ordering->SetOrigin(sliceOrigin);
+    worker.Ordering->Allocate();
+    }
+
+  SliceThreadStruct str;
+  str.Filter = this;
+  this->GetMultiThreader()->SetNumberOfThreads(threads);
+  this->GetMultiThreader()->SetSingleMethod(SliceThreaderCallback, &str);
+  this->GetMultiThreader()->SingleMethodExecute();
+
+  // the thinning storage is only kept over the slices of this run
+  for (unsigned t = 0; t < threads; t++)
+    {
+    m_Workers[t].Thinner->ReleaseWorkingMemory();
+    }
+}
+
+template <class TImage, class TOutImage>
+ITK_THREAD_RETURN_TYPE
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::SliceThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+    static_cast<MultiThreader::ThreadInfoStruct *>(arg);
+  SliceThreadStruct * str = static_cast<SliceThreadStruct *>(info->UserData);
+  str->Filter->ThreadedSlices(info->ThreadID, info->NumberOfThreads);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TImage, class TOutImage>
+void
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::ThreadedSlices(unsigned threadId, unsigned threadCount)
+{
+  SliceWorker &worker = m_Workers[threadId];
+  const unsigned long slices = m_Size[m_SliceDirection];
+  unsigned long sliceVoxels = 1;
+  for (unsigned k = 0; k < SliceDimension; k++)
+    {
+    sliceVoxels *= m_Size[m_InPlane[k]];
+    }
+
+  // the slices normal to the last dimension are contiguous in the
+  // output, so the thinning can write to them directly
+  const bool inPlace = (m_SliceDirection == ImageDimension - 1)
+    && (m_OutputStrides[m_SliceDirection] == sliceVoxels);
+
+  // the slices are interleaved, so that neighbouring slices, which
+  // tend to cost the same, go to different threads
+  ProgressReporter progress(this, threadId,
+			    (slices - threadId + threadCount - 1) / threadCount);
+  for (unsigned long slice = threadId; slice < slices; slice += threadCount)
+    {
+    OutputPixelType * outSlice = m_OutputStart + slice * m_OutputStrides[m_SliceDirection];
+    const bool foreground = SliceDistance(slice, worker);
+    if (inPlace)
+      {
+      if (foreground)
+	{
+	worker.Output->GetPixelContainer()->SetImportPointer(outSlice, sliceVoxels, false);
+	worker.Thinner->ProcessImage(worker.Ordering, worker.Output);
+	}
+      else
+	{
+	std::fill(outSlice, outSlice + sliceVoxels, NumericTraits<OutputPixelType>::Zero);
+	}
+      progress.CompletedPixel();
+      continue;
+      }
+
+    if (foreground)
+      {
+      worker.Thinner->ProcessImage(worker.Ordering, worker.Output);
+      }
+    // scatter the slice, raster order in the slice
+    const OutputPixelType * skel = worker.Output->GetBufferPointer();
+    const unsigned long length = m_Size[m_InPlane[0]];
+    const unsigned long stride = m_OutputStrides[m_InPlane[0]];
+    for (unsigned long start = 0; start < sliceVoxels; start += length)
+      {
+      unsigned long off = 0;
+      unsigned long rest = start / length;
+      for (unsigned k = 1; k < SliceDimension; k++)
+	{
+	off += (rest % m_Size[m_InPlane[k]]) * m_OutputStrides[m_InPlane[k]];
+	rest /= m_Size[m_InPlane[k]];
+	}
+      OutputPixelType * out = outSlice + off;
+      for (unsigned long x = 0; x < length; x++, out += stride)
+	{
+	*out = foreground ? skel[start + x] : NumericTraits<OutputPixelType>::Zero;
+	}
+      }
+    progress.CompletedPixel();
+    }
+
+  if (inPlace)
+    {
+    // don't keep a pointer to the output between runs
+    worker.Output->GetPixelContainer()->Initialize();
+    }
+}
+
+template <class TImage, class TOutImage>
+bool
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::SliceDistance(unsigned long slice, SliceWorker &worker)
+{
+  // the slice is laid out in the ordering image with its first
+  // dimension varying fastest
+  unsigned long sliceSize[SliceDimension];
+  unsigned long sliceStrides[SliceDimension];
+  unsigned long total = 1;
+  unsigned long longest = 0;
+  for (unsigned k = 0; k < SliceDimension; k++)
+    {
+    sliceSize[k] = m_Size[m_InPlane[k]];
+    sliceStrides[k] = total;
+    total *= sliceSize[k];
+    longest = std::max(longest, sliceSize[k]);
+    }
+  worker.Squared.resize(total);
+  worker.Line.resize(longest);
+  worker.Result.resize(longest);
+  worker.Z.resize(longest + 1);
+  worker.V.resize(longest);
+
+  // the squared distance is zero on the background, unknown elsewhere
+  const double infinity = NumericTraits<double>::max();
+  const InputPixelType * inSlice = m_InputStart + slice * m_InputStrides[m_SliceDirection];
+  const unsigned long length = sliceSize[0];
+  const unsigned long stride = m_InputStrides[m_InPlane[0]];
+  bool foreground = false;
+  for (unsigned long start = 0; start < total; start += length)
+    {
+    unsigned long off = 0;
+    unsigned long rest = start / length;
+    for (unsigned k = 1; k < SliceDimension; k++)
+      {
+      off += (rest % sliceSize[k]) * m_InputStrides[m_InPlane[k]];
+      rest /= sliceSize[k];
+      }
+    const InputPixelType * in = inSlice + off;
+    double * squared = &worker.Squared[start];
+    for (unsigned long x = 0; x < length; x++, in += stride)
+      {
+      const bool inside = (*in == m_ForegroundValue);
+      squared[x] = inside ? infinity : 0;
+      foreground |= inside;
+      }
+    }
+  if (!foreground)
+    {
+    return false;
+    }
+
+  // the lines of each dimension of the slice in turn, as
+  // SeparableDistanceMapImageFilter does
+  for (unsigned k = 0; k < SliceDimension; k++)
+    {
+    const unsigned long n = sliceSize[k];
+    const unsigned long lineStride = sliceStrides[k];
+    const unsigned long lines = total / n;
+    for (unsigned long line = 0; line < lines; line++)
+      {
+      unsigned long start = 0;
+      unsigned long rest = line;
+      for (unsigned j = 0; j < SliceDimension; j++)
+	{
+	if (j == k) continue;
+	start += (rest % sliceSize[j]) * sliceStrides[j];
+	rest /= sliceSize[j];
+	}
+      double * buffer = &worker.Squared[start];
+      for (unsigned long i = 0; i < n; i++)
+	{
+	worker.Line[i] = buffer[i * lineStride];
+	}
+      SquaredDistanceLine(&worker.Line[0], n, m_Spacing[m_InPlane[k]],
+			  &worker.Result[0], &worker.V[0], &worker.Z[0]);
+      for (unsigned long i = 0; i < n; i++)
+	{
+	buffer[i * lineStride] = worker.Result[i];
+	}
+      }
+    }
+
+  const float maxDistance = NumericTraits<float>::max();
+  float * ordering = worker.Ordering->GetBufferPointer();
+  for (unsigned long i = 0; i < total; i++)
+    {
+    const double D = worker.Squared[i];
+    ordering[i] = (D == infinity) ? maxDistance : static_cast<float>(std::sqrt(D));
+    }
+  return true;
+}
+
+template <class TImage, class TOutImage>
+void
+SliceSkeletonizeImageFilter<TImage, TOutImage>
+::PrintSelf(std::ostream &os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "ForegroundValue: " << static_cast<typename NumericTraits<InputPixelType>::PrintType>(m_ForegroundValue) << std::endl;
+  os << indent << "ForegroundCellConnectivity: " << m_ForegroundCellConnectivity << std::endl;
+  os << indent << "BackgroundCellConnectivity: " << m_BackgroundCellConnectivity << std::endl;
+  os << indent << "SliceDirection: " << m_SliceDirection << std::endl;
+  os << indent << "UseImageSpacing: " << m_UseImageSpacing << std::endl;
+}
+
+} // end namespace itk
+
+#endif
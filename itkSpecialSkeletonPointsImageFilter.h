@@ -1,6 +1,8 @@
 #ifndef __itkSpecialSkeletonPointsImageFilter_h
 #define __itkSpecialSkeletonPointsImageFilter_h
 
+#include "itkNeighborCountKernels.h"
+
 namespace itk
 {
 /** \class SpecialSkeletonPointsImageFilter
@@ -9,6 +11,18 @@ namespace itk
 * neighbours
 *
 * The background is assumed to be zero, skeleton non zero.
+*
+* By default the output marks with 1 the end points (one neighbour),
+* or the branch points (three or more neighbours) when EndPoints is
+* off. When LabelPoints is on, every skeleton voxel is labelled
+* instead, so that one run gives all the point sets: EndPoint,
+* CurvePoint (two neighbours), BranchPoint or IsolatedPoint (no
+* neighbour), the background staying zero.
+*
+* Each voxel only depends on its neighbourhood in the input, so the
+* output is split between the threads. The input foreground is first
+* copied to a padded byte buffer, so the neighbours are counted a line
+* at a time by NeighborCountKernel.
 * 
 * The CellConnectivity must match that of the skeleton
 *
@@ -56,6 +70,15 @@ public:
   /** Pointer Type for the output image. */
   typedef typename OutputImageType::Pointer OutputImagePointer;
   typedef typename OutputImageType::PixelType OutputPixelType ;
+  typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+  /** the labels of the skeleton voxels when LabelPoints is on */
+  typedef enum {
+    EndPoint = 1,
+    CurvePoint = 2,
+    BranchPoint = 3,
+    IsolatedPoint = 4
+  } PointLabelType;
 
   /** ImageDimension enumeration   */
   itkStaticConstMacro(InputImageDimension, unsigned int,
@@ -70,6 +93,13 @@ public:
   itkGetConstReferenceMacro(EndPoints, bool);
   itkBooleanMacro(EndPoints);
 
+  /** Set/Get whether every skeleton voxel is labelled with its
+   * PointLabelType, instead of marking only the end or branch
+   * points. EndPoints is ignored when set. Defaults to false */
+  itkSetMacro(LabelPoints, bool);
+  itkGetConstReferenceMacro(LabelPoints, bool);
+  itkBooleanMacro(LabelPoints);
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Start concept checking */
   itkConceptMacro(SameDimensionCheck,
@@ -87,12 +117,25 @@ protected:
   //typedef typename OutputImageType::IndexType IndexType;
 
   typedef std::vector<IndexType> IndexVec;
-  /** Compute thinning Image. */
-  void GenerateData();
+  /** Copy the input foreground to the byte buffer */
+  void BeforeThreadedGenerateData();
+
+  /** Classify the voxels of a part of the output */
+  void ThreadedGenerateData(const OutputImageRegionType& outputRegionForThread,
+			    int threadId);
+
+  /** Release the byte buffer */
+  void AfterThreadedGenerateData();
+
+  typedef NeighborCountKernel<itkGetStaticConstMacro(InputImageDimension)> KernelType;
 
 private:
   unsigned m_ForegroundCellConnectivity;
   bool m_EndPoints;
+  bool m_LabelPoints;
+
+  KernelType m_Kernel;
+  std::vector<unsigned char> m_Buffer;
 
 };
 
@@ -2,9 +2,8 @@
 #define _itkSpecialSkeletonPointsImageFilter_txx
 
 #include "itkSpecialSkeletonPointsImageFilter.h"
-#include "itkImageRegionConstIterator.h"
-#include "itkConstShapedNeighborhoodIterator.h"
-#include "itkConstantBoundaryCondition.h"
+#include "itkImageLinearIteratorWithIndex.h"
+#include "itkProgressReporter.h"
 
 namespace itk
 {
@@ -17,6 +16,7 @@ SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
 
   m_ForegroundCellConnectivity = 0;
   m_EndPoints = true; // find endpoints, not branch points
+  m_LabelPoints = false;
 }
 
 template <class TInputImage,class TOutputImage>
@@ -48,84 +48,94 @@ SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
 template <class TInputImage,class TOutputImage>
 void 
 SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
-::GenerateData() 
+::BeforeThreadedGenerateData()
+{
+  InputImagePointer  inputImage  = this->GetInput();
+  const RegionType region = inputImage->GetRequestedRegion();
+
+  m_Kernel.Initialize(region.GetSize(), m_ForegroundCellConnectivity);
+  m_Buffer.assign(m_Kernel.GetBufferSize(), 0);
+  m_Kernel.Fill(&m_Buffer[0], inputImage.GetPointer(), region);
+}
+
+template <class TInputImage,class TOutputImage>
+void 
+SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
+::ThreadedGenerateData(const OutputImageRegionType& outputRegionForThread,
+		       int threadId)
 {
-  this->AllocateOutputs();
-InputImagePointer  inputImage  = this->GetInput();
   OutputImagePointer outputImage = this->GetOutput();
-  outputImage->FillBuffer(0);
-  typename OutputImageType::RegionType region  = this->GetOutput()->GetRequestedRegion();
+  const IndexType start = outputImage->GetRequestedRegion().GetIndex();
   
-  ProgressReporter progress(this, 0, region.GetNumberOfPixels());
-  ImageRegionConstIterator< TInputImage >  it( inputImage,  region );
+  ProgressReporter progress(this, threadId, outputRegionForThread.GetNumberOfPixels());
 
-  
-  typedef typename std::vector<IndexType> IndVecType;
-  IndVecType AllIndexes;
+  ImageLinearIteratorWithIndex< TOutputImage > ot( outputImage, outputRegionForThread );
+  ot.SetDirection(0);
 
-  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
-    {
-    if (it.Get() != 0)
-      {
-      AllIndexes.push_back(it.GetIndex());
-      }
-    progress.CompletedPixel();
-    }
-  
-  typedef ConstShapedNeighborhoodIterator<OutputImageType> ShapedNeighborhoodIteratorType;
-  typename ShapedNeighborhoodIteratorType::RadiusType radius;
-  radius.Fill(1);
-  ShapedNeighborhoodIteratorType sIt(radius, inputImage, region);
-  typename ShapedNeighborhoodIteratorType::ConstIterator nIt;
-
-  ConstantBoundaryCondition<OutputImageType> bc;
-  bc.SetConstant(0);
-  sIt.OverrideBoundaryCondition(&bc);
-  setCellConnectivity( &sIt, m_ForegroundCellConnectivity);
-
-  if (m_EndPoints)
+  const unsigned long length = outputRegionForThread.GetSize()[0];
+  std::vector<unsigned char> counts(length);
+
+  for (ot.GoToBegin(); !ot.IsAtEnd(); ot.NextLine())
     {
-    // now check the list of indexes
-    for (typename IndVecType::const_iterator V=AllIndexes.begin();
-	 V != AllIndexes.end(); V++)
+    // the neighbour counts of the whole line
+    const unsigned long off = m_Kernel.ComputeOffset(ot.GetIndex() - start);
+    const unsigned char *centre = &m_Buffer[off];
+    if (IsZeroRow(centre, length))
       {
-      sIt += (*V) - sIt.GetIndex();
-    
-      // now count the neighbours
-      unsigned ncount = 0;
-      for (nIt = sIt.Begin(); nIt != sIt.End(); nIt++)
+      for (; !ot.IsAtEndOfLine(); ++ot)
 	{
-	ncount += (nIt.Get() != 0);
-	if (ncount > 1) break;
-	}
-
-      if (ncount == 1)
-	{
-	outputImage->SetPixel((*V), 1);
+	ot.Set(0);
+	progress.CompletedPixel();
 	}
+      continue;
       }
-    }
-  else 
-    {
-    // I think we need a two pass process here
-    for (typename IndVecType::const_iterator V=AllIndexes.begin();
-	 V != AllIndexes.end(); V++)
+    m_Kernel.CountLine(&m_Buffer[0], off, length, &counts[0]);
+    for (unsigned long x = 0; !ot.IsAtEndOfLine(); ++ot, ++x)
       {
-      sIt += (*V) - sIt.GetIndex();
-      // now count the neighbours
-      unsigned ncount = 0;
-      for (nIt = sIt.Begin(); nIt != sIt.End(); nIt++)
-	{
-	ncount += (nIt.Get() != 0);
-	}
-      if (ncount >= 3)
+      OutputPixelType label = 0;
+      if (centre[x])
 	{
-	outputImage->SetPixel((*V), 1);
+	const unsigned ncount = counts[x];
+	if (m_LabelPoints)
+	  {
+	  switch (ncount)
+	    {
+	    case 0:
+	      label = IsolatedPoint;
+	      break;
+	    case 1:
+	      label = EndPoint;
+	      break;
+	    case 2:
+	      label = CurvePoint;
+	      break;
+	    default:
+	      label = BranchPoint;
+	    }
+	  }
+	else if (m_EndPoints)
+	  {
+	  label = (ncount == 1);
+	  }
+	else
+	  {
+	  label = (ncount >= 3);
+	  }
 	}
+      ot.Set(label);
+      progress.CompletedPixel();
       }
     }
 }
 
+template <class TInputImage,class TOutputImage>
+void 
+SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
+::AfterThreadedGenerateData()
+{
+  std::vector<unsigned char>().swap(m_Buffer);
+}
+
 template <class TInputImage,class TOutputImage>
 void 
 SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
@@ -136,6 +146,7 @@ SpecialSkeletonPointsImageFilter<TInputImage,TOutputImage>
   os << indent << "Special Skeleton Points: " << std::endl;
   os << indent << "Connectivity: " << m_ForegroundCellConnectivity << std::endl;
   os << indent << "EndPoints: " << m_EndPoints << std::endl;
+  os << indent << "LabelPoints: " << m_LabelPoints << std::endl;
 
 }
 
@@ -0,0 +1,152 @@
+#ifndef __itkSpurPruningImageFilter_h
+#define __itkSpurPruningImageFilter_h
+
+#include <itkImageToImageFilter.h>
+#include <itkProgressReporter.h>
+#include "itkNeighborCountKernels.h"
+
+namespace itk
+{
+/** \class SpurPruningImageFilter
+ *
+ * \brief Removes the terminal branches of a skeleton that are
+ * shorter than a physical length
+ *
+ * The background is assumed to be zero and the skeleton non zero.
+ *
+ * The neighbours of every skeleton voxel are counted by
+ * NeighborCountKernel, as in SpecialSkeletonPointsImageFilter, on a
+ * byte copy of the skeleton: voxels with one neighbour are end
+ * points, voxels with three or more are branch points. Each end point
+ * is followed along the branch, through voxels with two neighbours,
+ * until a branch point is reached. The length of the branch is the
+ * sum of the physical lengths of its steps (see UseImageSpacing),
+ * from the end point to the branch point, and the voxels of the
+ * branch, but not the branch point, are removed if it is shorter than
+ * MaximumSpurLength. Branches that end at another end point are
+ * isolated curves, not spurs, and are kept whatever their length.
+ *
+ * Unlike FastBinaryPruningImageFilter, which erodes the end points
+ * of the whole skeleton once per iteration, a single traversal
+ * handles spurs of any length. Removing spurs can turn a branch point
+ * into a plain curve voxel, or into the end point of a new spur; set
+ * RepeatUntilStable to prune again until nothing changes.
+ *
+ * The CellConnectivity must match that of the skeleton.
+ *
+ * \author Richard Beare
+ */
+template <class TInputImage,class TOutputImage>
+class ITK_EXPORT SpurPruningImageFilter :
+    public ImageToImageFilter<TInputImage,TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef SpurPruningImageFilter    Self;
+  typedef ImageToImageFilter<TInputImage,TOutputImage> Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( SpurPruningImageFilter, ImageToImageFilter );
+
+  /** Type for input image. */
+  typedef   TInputImage       InputImageType;
+
+  /** Type for output image: the pruned skeleton.  */
+  typedef   TOutputImage      OutputImageType;
+
+  /** Type for the region of the input image. */
+  typedef typename InputImageType::RegionType   RegionType;
+
+  /** Type for the index of the input image. */
+  typedef typename RegionType::IndexType  IndexType;
+
+  /** Type for the pixel of the input image. */
+  typedef typename InputImageType::PixelType PixelType ;
+
+  /** Pointer Type for input image. */
+  typedef typename InputImageType::ConstPointer InputImagePointer;
+
+  /** Pointer Type for the output image. */
+  typedef typename OutputImageType::Pointer OutputImagePointer;
+  typedef typename OutputImageType::PixelType OutputPixelType ;
+
+  /** ImageDimension enumeration   */
+  itkStaticConstMacro(InputImageDimension, unsigned int,
+                      TInputImage::ImageDimension );
+  itkStaticConstMacro(OutputImageDimension, unsigned int,
+                      TOutputImage::ImageDimension );
+
+  itkSetMacro(ForegroundCellConnectivity, unsigned);
+  itkGetMacro(ForegroundCellConnectivity, unsigned);
+
+  /** Set/Get the length below which terminal branches are
+   * removed. Defaults to 0 - nothing is removed */
+  itkSetMacro(MaximumSpurLength, double);
+  itkGetConstMacro(MaximumSpurLength, double);
+
+  /** Set/Get whether the lengths are physical lengths or numbers of
+   * voxel steps (1 for a face neighbour, sqrt(2) for an edge
+   * neighbour...). Defaults to true */
+  itkSetMacro(UseImageSpacing, bool);
+  itkGetConstReferenceMacro(UseImageSpacing, bool);
+  itkBooleanMacro(UseImageSpacing);
+
+  /** Set/Get whether the pruning is repeated, on the pruned skeleton,
+   * until no spur is removed. Defaults to false - one traversal */
+  itkSetMacro(RepeatUntilStable, bool);
+  itkGetConstReferenceMacro(RepeatUntilStable, bool);
+  itkBooleanMacro(RepeatUntilStable);
+
+  /** Get the number of voxels removed by the last update */
+  itkGetConstMacro(NumberOfRemovedVoxels, unsigned long);
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  /** Start concept checking */
+  itkConceptMacro(SameDimensionCheck,
+    (Concept::SameDimension<InputImageDimension, OutputImageDimension>));
+#endif
+
+  virtual void GenerateInputRequestedRegion() throw(InvalidRequestedRegionError);
+protected:
+  SpurPruningImageFilter();
+  virtual ~SpurPruningImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  void EnlargeOutputRequestedRegion(DataObject *itkNotUsed(output));
+
+  typedef NeighborCountKernel<itkGetStaticConstMacro(OutputImageDimension)> KernelType;
+  typedef std::vector<unsigned long> OffsetVec;
+  void GenerateData();
+
+  // one traversal of the skeleton voxels in v, offsets in the padded
+  // byte buffer of the skeleton, removing the short spurs from buffer
+  // and from v. counts is work space of the size of buffer. Returns
+  // the number of removed voxels
+  unsigned long PruneSpurs(unsigned char *buffer, unsigned char *counts,
+			   OffsetVec &v, ProgressReporter &progress);
+
+private:
+  SpurPruningImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  unsigned m_ForegroundCellConnectivity;
+  double m_MaximumSpurLength;
+  bool m_UseImageSpacing;
+  bool m_RepeatUntilStable;
+  unsigned long m_NumberOfRemovedVoxels;
+
+  KernelType m_Kernel;
+};
+
+} // namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSpurPruningImageFilter.txx"
+#endif
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef _itkSpurPruningImageFilter_txx
+#define _itkSpurPruningImageFilter_txx
+
+#include <cmath>
+#include <algorithm>
+
+#include "itkSpurPruningImageFilter.h"
+#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkImageLinearIteratorWithIndex.h"
+#include "itkNumericTraits.h"
+
+namespace itk
+{
+
+template <class TInputImage,class TOutputImage>
+SpurPruningImageFilter<TInputImage,TOutputImage>
+::SpurPruningImageFilter()
+{
+  this->SetNumberOfRequiredOutputs( 1 );
+
+  m_ForegroundCellConnectivity = 0;
+  m_MaximumSpurLength = 0;
+  m_UseImageSpacing = true;
+  m_RepeatUntilStable = false;
+  m_NumberOfRemovedVoxels = 0;
+}
+
+template <class TInputImage,class TOutputImage>
+void
+SpurPruningImageFilter<TInputImage,TOutputImage>
+::GenerateInputRequestedRegion() throw(InvalidRequestedRegionError)
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateInputRequestedRegion();
+
+  // We need all the input.
+  typename Superclass::InputImagePointer input = const_cast<TInputImage *>(this->GetInput());
+  if( !input )
+    {
+    return;
+    }
+  input->SetRequestedRegion( input->GetLargestPossibleRegion() );
+}
+
+template <class TInputImage,class TOutputImage>
+void
+SpurPruningImageFilter<TInputImage,TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *)
+{
+  this->GetOutput()
+    ->SetRequestedRegion( this->GetOutput()->GetLargestPossibleRegion() );
+}
+
+template <class TInputImage,class TOutputImage>
+unsigned long
+SpurPruningImageFilter<TInputImage,TOutputImage>
+::PruneSpurs(unsigned char *buffer, unsigned char *counts,
+	     OffsetVec &v, ProgressReporter &progress)
+{
+  typedef typename KernelType::OffsetType PositionType;
+
+  // neighbour counts of the skeleton voxels, before any removal
+  m_Kernel.CountForeground(buffer, counts);
+
+  double spacing[OutputImageDimension];
+  for (unsigned d = 0; d < OutputImageDimension; d++)
+    {
+    spacing[d] = m_UseImageSpacing ? this->GetOutput()->GetSpacing()[d] : 1.0;
+    }
+
+  // follow the branches from the end points
+  unsigned long removed = 0;
+  OffsetVec branch;
+  typedef typename OffsetVec::const_iterator vecItType;
+  for (vecItType V = v.begin(); V != v.end(); V++)
+    {
+    progress.CompletedPixel();
+    if (counts[*V] != 1)
+      {
+      continue;
+      }
+    // the voxels of the branch have one (the end point) or two
+    // neighbours
+    branch.assign(1, *V);
+    const unsigned long end =
+      m_Kernel.WalkChain(buffer, counts, *V, m_Kernel.NextVoxel(buffer, *V, *V),
+			 *V, branch);
+
+    // from the end point to the voxel the walk stopped at
+    double length = 0;
+    PositionType previous = m_Kernel.ComputePosition(branch[0]);
+    for (unsigned long i = 1; i <= branch.size(); i++)
+      {
+      const PositionType current =
+	m_Kernel.ComputePosition(i < branch.size() ? branch[i] : end);
+      double step = 0;
+      for (unsigned d = 0; d < OutputImageDimension; d++)
+	{
+	const double delta = (current[d] - previous[d]) * spacing[d];
+	step += delta * delta;
+	}
+      length += std::sqrt(step);
+      previous = current;
+      }
+
+    if (counts[end] >= 3 && length < m_MaximumSpurLength)
+      {
+      // a short spur - the branch point stays
+      for (vecItType B = branch.begin(); B != branch.end(); B++)
+	{
+	buffer[*B] = 0;
+	}
+      removed += branch.size();
+      }
+    // otherwise a long spur, or an isolated curve ending at another
+    // end point
+    }
+
+  // keep the remaining voxels for the next traversal
+  if (removed > 0)
+    {
+    OffsetVec remaining;
+    remaining.reserve(v.size() - removed);
+    for (vecItType V = v.begin(); V != v.end(); V++)
+      {
+      if (buffer[*V])
+	{
+	remaining.push_back(*V);
+	}
+      }
+    v.swap(remaining);
+    }
+  return removed;
+}
+
+template <class TInputImage,class TOutputImage>
+void
+SpurPruningImageFilter<TInputImage,TOutputImage>
+::GenerateData()
+{
+  this->AllocateOutputs();
+  InputImagePointer  inputImage  = this->GetInput();
+  OutputImagePointer outputImage = this->GetOutput();
+  typename OutputImageType::RegionType region  = this->GetOutput()->GetRequestedRegion();
+
+  // collecting the skeleton is the first half of the progress
+  ProgressReporter progress(this, 0, region.GetNumberOfPixels(), 100, 0.0f, 0.5f);
+
+  // the skeleton as a padded byte buffer, which the pruning works on
+  m_Kernel.Initialize(region.GetSize(), m_ForegroundCellConnectivity);
+  std::vector<unsigned char> buffer(m_Kernel.GetBufferSize(), 0);
+  std::vector<unsigned char> counts(m_Kernel.GetBufferSize(), 0);
+  m_Kernel.Fill(&buffer[0], inputImage.GetPointer(), region);
+
+  OffsetVec v;
+  const unsigned long lines = m_Kernel.GetNumberOfLines();
+  const unsigned long length = region.GetSize()[0];
+  for (unsigned long line = 0; line < lines; line++)
+    {
+    const unsigned long start = m_Kernel.GetLineOffset(line);
+    for (unsigned long x = 0; x < length; x++)
+      {
+      if (buffer[start + x])
+	{
+	v.push_back(start + x);
+	}
+      progress.CompletedPixel();
+      }
+    }
+
+  // a single traversal takes the second half. The number of
+  // traversals until nothing changes isn't known, so each one takes
+  // half of what is left
+  m_NumberOfRemovedVoxels = 0;
+  unsigned long removed;
+  float done = 0.5f;
+  do
+    {
+    const float weight = m_RepeatUntilStable ? (1.0f - done) / 2 : 1.0f - done;
+    ProgressReporter passProgress(this, 0, v.size(), 100, done, weight);
+    removed = PruneSpurs(&buffer[0], &counts[0], v, passProgress);
+    m_NumberOfRemovedVoxels += removed;
+    done += weight;
+    }
+  while (m_RepeatUntilStable && removed > 0);
+  this->UpdateProgress(1.0f);
+
+  // the input values of the voxels that are left
+  ImageLinearConstIteratorWithIndex< TInputImage > it( inputImage, region );
+  ImageLinearIteratorWithIndex< TOutputImage > ot( outputImage, region );
+  it.SetDirection(0);
+  ot.SetDirection(0);
+  for (it.GoToBegin(), ot.GoToBegin(); !ot.IsAtEnd(); it.NextLine(), ot.NextLine())
+    {
+    unsigned long off = m_Kernel.ComputeOffset(ot.GetIndex() - region.GetIndex());
+    for (; !ot.IsAtEndOfLine(); ++it, ++ot, ++off)
+      {
+      ot.Set(buffer[off] ? static_cast< OutputPixelType >(it.Get()) :
+	     NumericTraits< OutputPixelType >::Zero);
+      }
+    }
+}
+
+template <class TInputImage,class TOutputImage>
+void
+SpurPruningImageFilter<TInputImage,TOutputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os,indent);
+
+  os << indent << "Connectivity: " << m_ForegroundCellConnectivity << std::endl;
+  os << indent << "MaximumSpurLength: " << m_MaximumSpurLength << std::endl;
+  os << indent << "UseImageSpacing: " << m_UseImageSpacing << std::endl;
+  os << indent << "RepeatUntilStable: " << m_RepeatUntilStable << std::endl;
+  os << indent << "NumberOfRemovedVoxels: " << m_NumberOfRemovedVoxels << std::endl;
+}
+
+} // end namespace itk
+
+#endif
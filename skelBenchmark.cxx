@@ -0,0 +1,269 @@
+#include "itkImage.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkSeparableDistanceMapImageFilter.h"
+#include "itkSkeletonizeBaseImageFilter.h"
+#include "itkSkeletonizeImageFilter.h"
+#include "itkFastBinaryPruningImageFilter.h"
+#include "itkNewBinaryPruningImageFilter.h"
+#include "itkSpecialSkeletonPointsImageFilter.h"
+#include "itkTimeProbe.h"
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// times the skeletonization, pruning and special point filters on
+// synthetic masks and prints one line of comma separated values per
+// filter and mask, for comparison between versions and machines.
+//
+// The masks are a centred sphere (a disk in 2D), a tube along the
+// first axis (a band in 2D) and a union of random balls, of several
+// sizes. The pruners and the special point filter run on the skeleton
+// of the mask. Queue pushes are reported for the thinning filters,
+// and 0 for the others. The peak resident size is that of the whole
+// process so far, in kilobytes, and only grows from one line to the
+// next.
+
+static long peakRSS()
+{
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+    return usage.ru_maxrss;
+    }
+#endif
+  return -1;
+}
+
+template <class TImage>
+typename TImage::Pointer makeMask(const std::string &shape, unsigned size)
+{
+  const unsigned dim = TImage::ImageDimension;
+  typename TImage::Pointer mask = TImage::New();
+  typename TImage::SizeType sz;
+  sz.Fill(size);
+  typename TImage::RegionType region;
+  region.SetSize(sz);
+  mask->SetRegions(region);
+  mask->Allocate();
+  mask->FillBuffer(0);
+
+  // ball centres and radii
+  std::vector<std::vector<double> > centres;
+  std::vector<double> radii;
+  if (shape == "sphere")
+    {
+    centres.push_back(std::vector<double>(dim, (size - 1) / 2.0));
+    radii.push_back(0.4 * size);
+    }
+  else if (shape == "blobs")
+    {
+    srand(size * dim);
+    const unsigned balls = 4 << dim;
+    for (unsigned b = 0; b < balls; b++)
+      {
+      std::vector<double> c(dim);
+      for (unsigned d = 0; d < dim; d++)
+	{
+	c[d] = rand() % size;
+	}
+      centres.push_back(c);
+      radii.push_back(size * (0.03 + 0.07 * (rand() / (double)RAND_MAX)));
+      }
+    }
+
+  itk::ImageRegionIteratorWithIndex<TImage> it(mask, region);
+  for (; !it.IsAtEnd(); ++it)
+    {
+    const typename TImage::IndexType ind = it.GetIndex();
+    bool inside = false;
+    if (shape == "tube")
+      {
+      // distance to the line through the centre along the first axis
+      double s = 0;
+      for (unsigned d = 1; d < dim; d++)
+	{
+	const double delta = ind[d] - (size - 1) / 2.0;
+	s += delta * delta;
+	}
+      inside = (s <= (size / 6.0) * (size / 6.0));
+      }
+    for (unsigned b = 0; b < centres.size() && !inside; b++)
+      {
+      double s = 0;
+      for (unsigned d = 0; d < dim; d++)
+	{
+	const double delta = ind[d] - centres[b][d];
+	s += delta * delta;
+	}
+      inside = (s <= radii[b] * radii[b]);
+      }
+    it.Set(inside ? 1 : 0);
+    }
+  return mask;
+}
+
+template <class TImage>
+unsigned long countForeground(const TImage *image)
+{
+  unsigned long count = 0;
+  itk::ImageRegionConstIterator<TImage> it(image, image->GetLargestPossibleRegion());
+  for (; !it.IsAtEnd(); ++it)
+    {
+    count += (it.Get() != 0);
+    }
+  return count;
+}
+
+static void report(const char *filter, unsigned dim, const std::string &shape,
+		   unsigned size, unsigned long voxels, unsigned long foreground,
+		   itk::TimeProbe &timer, unsigned long pushes)
+{
+  const double seconds = timer.GetMeanTime();
+  std::cout << filter << "," << dim << "," << shape << "," << size << ","
+	    << voxels << "," << foreground << "," << seconds << ","
+	    << (seconds > 0 ? voxels / seconds : 0) << "," << peakRSS() << ","
+	    << pushes << std::endl;
+}
+
+template <unsigned dim>
+void benchmark(const std::vector<unsigned> &sizes, int repeats)
+{
+  typedef itk::Image<unsigned char, dim> IType;
+  typedef itk::Image<float, dim> DistType;
+
+  typedef itk::SeparableDistanceMapImageFilter<IType, DistType> DTType;
+  typedef itk::SkeletonizeBaseImageFilter<DistType, IType> SkelBaseType;
+  typedef itk::SkeletonizeImageFilter<IType, IType> SkelType;
+  typedef itk::FastBinaryPruningImageFilter<IType, IType> FastPruneType;
+  typedef itk::NewBinaryPruningImageFilter<IType, IType> NewPruneType;
+  typedef itk::SpecialSkeletonPointsImageFilter<IType, IType> SpecialType;
+
+  const char *shapes[] = {"sphere", "tube", "blobs"};
+  for (unsigned s = 0; s < sizes.size(); s++)
+    {
+    for (unsigned k = 0; k < 3; k++)
+      {
+      const std::string shape = shapes[k];
+      typename IType::Pointer mask = makeMask<IType>(shape, sizes[s]);
+      const unsigned long voxels = mask->GetLargestPossibleRegion().GetNumberOfPixels();
+      const unsigned long foreground = countForeground(mask.GetPointer());
+
+      typename DTType::Pointer dt = DTType::New();
+      dt->SetInput(mask);
+      dt->Update();
+
+      itk::TimeProbe baseTimer, skelTimer, fastTimer, newTimer, specialTimer;
+
+      typename SkelBaseType::Pointer skelBase = SkelBaseType::New();
+      skelBase->SetInput(dt->GetOutput());
+      skelBase->SetForegroundCellConnectivity(0);
+      skelBase->SetBackgroundCellConnectivity(dim - 1);
+      for (int r = 0; r < repeats; r++)
+	{
+	skelBase->Modified();
+	baseTimer.Start();
+	skelBase->Update();
+	baseTimer.Stop();
+	}
+      report("SkeletonizeBase", dim, shape, sizes[s], voxels, foreground,
+	     baseTimer, skelBase->GetNumberOfQueuePushes());
+
+      typename SkelType::Pointer skel = SkelType::New();
+      skel->SetInput(mask);
+      for (int r = 0; r < repeats; r++)
+	{
+	skel->Modified();
+	skelTimer.Start();
+	skel->Update();
+	skelTimer.Stop();
+	}
+      report("Skeletonize", dim, shape, sizes[s], voxels, foreground,
+	     skelTimer, skel->GetNumberOfQueuePushes());
+
+      // the rest runs on the skeleton
+      typename IType::Pointer skeleton = skel->GetOutput();
+      skeleton->DisconnectPipeline();
+      const unsigned long skelVoxels = countForeground(skeleton.GetPointer());
+
+      typename FastPruneType::Pointer fastPruner = FastPruneType::New();
+      fastPruner->SetInput(skeleton);
+      fastPruner->SetIteration(10);
+      for (int r = 0; r < repeats; r++)
+	{
+	fastPruner->Modified();
+	fastTimer.Start();
+	fastPruner->Update();
+	fastTimer.Stop();
+	}
+      report("FastBinaryPruning", dim, shape, sizes[s], voxels, skelVoxels,
+	     fastTimer, 0);
+
+      typename NewPruneType::Pointer newPruner = NewPruneType::New();
+      newPruner->SetInput(skeleton);
+      newPruner->SetIteration(10);
+      for (int r = 0; r < repeats; r++)
+	{
+	newPruner->Modified();
+	newTimer.Start();
+	newPruner->Update();
+	newTimer.Stop();
+	}
+      report("NewBinaryPruning", dim, shape, sizes[s], voxels, skelVoxels,
+	     newTimer, 0);
+
+      typename SpecialType::Pointer special = SpecialType::New();
+      special->SetInput(skeleton);
+      special->SetLabelPoints(true);
+      for (int r = 0; r < repeats; r++)
+	{
+	special->Modified();
+	specialTimer.Start();
+	special->Update();
+	specialTimer.Stop();
+	}
+      report("SpecialSkeletonPoints", dim, shape, sizes[s], voxels, skelVoxels,
+	     specialTimer, 0);
+      }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+
+  if( argc > 3 )
+    {
+    std::cerr << "usage: " << argv[0] << " [repeats [maxsize]]" << std::endl;
+    std::cerr << " repeats: number of runs of each filter. Defaults to 3" << std::endl;
+    std::cerr << " maxsize: largest edge length of the masks. Defaults to 512" << std::endl;
+    exit(1);
+    }
+
+  const int repeats = (argc > 1) ? std::max(atoi(argv[1]), 1) : 3;
+  const unsigned maxSize = (argc > 2) ? atoi(argv[2]) : 512;
+
+  std::vector<unsigned> sizes2D, sizes3D;
+  for (unsigned size = 64; size <= 512 && size <= maxSize; size *= 2)
+    {
+    sizes2D.push_back(size);
+    }
+  for (unsigned size = 32; size <= 128 && size <= maxSize; size *= 2)
+    {
+    sizes3D.push_back(size);
+    }
+
+  std::cout << "filter,dim,shape,size,voxels,foreground,seconds,voxels_per_second,"
+	    << "peak_rss_kb,queue_pushes" << std::endl;
+  benchmark<2>(sizes2D, repeats);
+  benchmark<3>(sizes3D, repeats);
+
+  return EXIT_SUCCESS;
+}
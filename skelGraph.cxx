@@ -0,0 +1,194 @@
+#include "ioutils.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkSeparableDistanceMapImageFilter.h"
+#include "itkSkeletonizeBaseImageFilter.h"
+#include "itkSkeletonGraphCalculator.h"
+#include <cmath>
+
+// checks the graph of a synthetic skeleton, then skeletonizes a mask
+// and prints the graph of its skeleton
+
+typedef itk::Image< unsigned char, 2 > SynthType;
+typedef itk::SkeletonGraphCalculator<SynthType> SynthGraphType;
+
+static void drawLine(SynthType *image, long x, long y, long dx, long dy, unsigned long steps)
+{
+  for (unsigned long i = 0; i < steps; i++, x += dx, y += dy)
+    {
+    SynthType::IndexType idx;
+    idx[0] = x;
+    idx[1] = y;
+    image->SetPixel(idx, 1);
+    }
+}
+
+// the node at (x, y) if it has the expected degree
+static bool checkNode(const SynthGraphType *graph, long x, long y,
+		      unsigned long degree, unsigned long &node)
+{
+  for (node = 0; node < graph->GetNumberOfNodes(); node++)
+    {
+    if (graph->GetNodeIndex(node)[0] == x && graph->GetNodeIndex(node)[1] == y)
+      {
+      if (graph->GetNodeDegree(node) == degree)
+	{
+	return true;
+	}
+      std::cout << "node (" << x << ", " << y << ") has degree "
+		<< graph->GetNodeDegree(node) << ", not " << degree << std::endl;
+      return false;
+      }
+    }
+  std::cout << "no node at (" << x << ", " << y << ")" << std::endl;
+  return false;
+}
+
+// whether there is an edge between the two nodes with the expected
+// length and number of voxels
+static bool checkEdge(const SynthGraphType *graph, unsigned long a, unsigned long b,
+		      double length, unsigned long voxels)
+{
+  for (unsigned long e = 0; e < graph->GetNumberOfEdges(); e++)
+    {
+    const SynthGraphType::EdgeType &edge = graph->GetEdge(e);
+    if (((edge.Source == a && edge.Target == b) || (edge.Source == b && edge.Target == a)) &&
+	std::fabs(edge.Length - length) < 1e-6 &&
+	graph->GetEdgeVoxelStarts()[e + 1] - graph->GetEdgeVoxelStarts()[e] == voxels)
+      {
+      return true;
+      }
+    }
+  std::cout << "no edge between nodes " << a << " and " << b << " of length "
+	    << length << " through " << voxels << " voxels" << std::endl;
+  return false;
+}
+
+// under face connectivity: a T, a closed square and a bar crossed by
+// two stems at neighbouring voxels
+static bool checkSynthetic()
+{
+  SynthType::SizeType size;
+  size.Fill(64);
+  SynthType::RegionType region;
+  region.SetSize(size);
+  SynthType::Pointer skel = SynthType::New();
+  skel->SetRegions(region);
+  skel->Allocate();
+  skel->FillBuffer(0);
+
+  drawLine(skel, 5, 10, 1, 0, 21);
+  drawLine(skel, 15, 11, 0, 1, 10);
+
+  drawLine(skel, 35, 5, 1, 0, 10);
+  drawLine(skel, 45, 5, 0, 1, 10);
+  drawLine(skel, 45, 15, -1, 0, 10);
+  drawLine(skel, 35, 15, 0, -1, 10);
+
+  drawLine(skel, 5, 50, 1, 0, 21);
+  drawLine(skel, 14, 49, 0, -1, 5);
+  drawLine(skel, 15, 51, 0, 1, 5);
+
+  SynthGraphType::Pointer graph = SynthGraphType::New();
+  graph->SetImage(skel);
+  graph->SetForegroundCellConnectivity(1);
+  graph->Compute();
+
+  bool ok = (graph->GetNumberOfNodes() == 11 && graph->GetNumberOfEdges() == 9);
+  if (!ok)
+    {
+    std::cout << "Synthetic: " << graph->GetNumberOfNodes() << " nodes and "
+	      << graph->GetNumberOfEdges() << " edges, not 11 and 9" << std::endl;
+    }
+  unsigned long left, right, bottom, junction;
+  ok = checkNode(graph, 5, 10, 1, left) && checkNode(graph, 25, 10, 1, right) &&
+    checkNode(graph, 15, 20, 1, bottom) && checkNode(graph, 15, 10, 3, junction) &&
+    checkEdge(graph, left, junction, 10, 9) && checkEdge(graph, right, junction, 10, 9) &&
+    checkEdge(graph, bottom, junction, 10, 9) && ok;
+
+  // the closed curve gets a node at its first voxel and an edge to
+  // itself
+  unsigned long corner;
+  ok = checkNode(graph, 35, 5, 2, corner) &&
+    checkEdge(graph, corner, corner, 40, 39) && ok;
+
+  // the two branch points are joined by an edge without voxels
+  unsigned long barLeft, barRight, top, foot, up, down;
+  ok = checkNode(graph, 5, 50, 1, barLeft) && checkNode(graph, 25, 50, 1, barRight) &&
+    checkNode(graph, 14, 45, 1, top) && checkNode(graph, 15, 55, 1, foot) &&
+    checkNode(graph, 14, 50, 3, up) && checkNode(graph, 15, 50, 3, down) &&
+    checkEdge(graph, up, down, 1, 0) && checkEdge(graph, barLeft, up, 9, 8) &&
+    checkEdge(graph, barRight, down, 10, 9) && checkEdge(graph, top, up, 5, 4) &&
+    checkEdge(graph, foot, down, 5, 4) && ok;
+
+  std::cout << "Synthetic: " << (ok ? "passed" : "failed") << std::endl;
+  return ok;
+}
+
+int main(int argc, char * argv[])
+{
+
+  if( argc != 2 )
+    {
+    std::cerr << "usage: " << argv[0] << " intput" << std::endl;
+    std::cerr << " input: the input image" << std::endl;
+    exit(1);
+    }
+
+  if (!checkSynthetic())
+    {
+    return EXIT_FAILURE;
+    }
+
+  const int dim = 2;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+  typedef itk::Image< float, dim > DistType;
+
+  IType::Pointer input = readIm<IType>(argv[1]);
+
+  typedef itk::BinaryThresholdImageFilter<IType, IType> ThreshType;
+  ThreshType::Pointer thresh = ThreshType::New();
+  thresh->SetInput(input);
+  thresh->SetUpperThreshold(130);
+  thresh->SetOutsideValue(0);
+  thresh->SetInsideValue(1);
+
+  // the distance transform orders the thinning and gives the radius
+  // of the branches
+  typedef itk::SeparableDistanceMapImageFilter<IType, DistType> DTType;
+  DTType::Pointer disttrans = DTType::New();
+  disttrans->SetInput(thresh->GetOutput());
+
+  typedef itk::SkeletonizeBaseImageFilter<DistType, IType> SkelType;
+  SkelType::Pointer skel = SkelType::New();
+  skel->SetInput(disttrans->GetOutput());
+  skel->SetForegroundCellConnectivity(0);
+  skel->SetBackgroundCellConnectivity(1);
+  skel->Update();
+
+  typedef itk::SkeletonGraphCalculator<IType, DistType> GraphType;
+  GraphType::Pointer graph = GraphType::New();
+  graph->SetImage(skel->GetOutput());
+  graph->SetRadiusImage(disttrans->GetOutput());
+  graph->SetForegroundCellConnectivity(0);
+  graph->Compute();
+
+  std::cout << graph->GetNumberOfNodes() << " nodes, "
+	    << graph->GetNumberOfEdges() << " edges" << std::endl;
+  std::cout << "node\tposition\tdegree" << std::endl;
+  for (unsigned long n = 0; n < graph->GetNumberOfNodes(); n++)
+    {
+    std::cout << n << "\t" << graph->GetNodeIndex(n) << "\t" << graph->GetNodeDegree(n) << std::endl;
+    }
+  std::cout << "edge\tsource\ttarget\tvoxels\tlength\tradius" << std::endl;
+  for (unsigned long e = 0; e < graph->GetNumberOfEdges(); e++)
+    {
+    const GraphType::EdgeType &edge = graph->GetEdge(e);
+    std::cout << e << "\t" << edge.Source << "\t" << edge.Target << "\t"
+	      << graph->GetEdgeVoxelStarts()[e + 1] - graph->GetEdgeVoxelStarts()[e] << "\t"
+	      << edge.Length << "\t" << edge.MeanRadius << std::endl;
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,451 @@
+#include "ioutils.h"
+#include "itkSkeletonizeBaseImageFilter.h"
+#include "itkDanielssonDistanceMapImageFilter.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include <vector>
+#include <string>
+
+// compares the skeleton of one of the threaded or quantized modes of
+// SkeletonizeBaseImageFilter with the serial one. The component mode
+// must give the same skeleton. The subfield and quantized modes may
+// remove the voxels in another order, so their skeletons must only
+// have the same topology: the same numbers of foreground and
+// background components, and nothing left to remove.
+//
+// The anchors mode thins with an anchor image of scattered mask
+// voxels, which must all be kept, with the same topology, and
+// nothing left to remove with the same anchors. An anchor image
+// smaller than the ordering image must be refused.
+//
+// The batch mode thins crops of several sizes of the image with one
+// filter through ProcessImage, and with a new filter each, which
+// must give the same skeletons. ProcessImage must leave the filter
+// without input, and with an output of its own.
+
+// number of components of the foreground (non zero) or background
+// voxels, under a cell connectivity. The background around the image
+// is one component, that all the background voxels of the border
+// belong to.
+template <class TImage>
+unsigned long countComponents(const TImage *image, bool foreground, unsigned cellConnectivity)
+{
+  typedef typename TImage::IndexType IndexType;
+  typedef typename TImage::OffsetType OffsetType;
+  const unsigned dim = TImage::ImageDimension;
+  const typename TImage::RegionType region = image->GetLargestPossibleRegion();
+
+  // the neighbors are the offsets with at least cellConnectivity zeros
+  std::vector<OffsetType> neighbors;
+  unsigned long cube = 1;
+  for (unsigned d = 0; d < dim; d++)
+    {
+    cube *= 3;
+    }
+  for (unsigned long pos = 0; pos < cube; pos++)
+    {
+    OffsetType off;
+    unsigned zeros = 0;
+    unsigned long rest = pos;
+    for (unsigned d = 0; d < dim; d++)
+      {
+      off[d] = (long)(rest % 3) - 1;
+      zeros += (off[d] == 0);
+      rest /= 3;
+      }
+    if (zeros < dim && zeros >= cellConnectivity)
+      {
+      neighbors.push_back(off);
+      }
+    }
+
+  std::vector<bool> seen(region.GetNumberOfPixels(), false);
+  unsigned long count = 0;
+  bool outside = false;
+  itk::ImageRegionConstIteratorWithIndex<TImage> it(image, region);
+  for (; !it.IsAtEnd(); ++it)
+    {
+    if (((it.Get() != 0) != foreground) || seen[image->ComputeOffset(it.GetIndex())])
+      {
+      continue;
+      }
+    bool border = false;
+    std::vector<IndexType> stack(1, it.GetIndex());
+    seen[image->ComputeOffset(it.GetIndex())] = true;
+    while (!stack.empty())
+      {
+      const IndexType current = stack.back();
+      stack.pop_back();
+      for (unsigned k = 0; k < neighbors.size(); k++)
+	{
+	const IndexType N = current + neighbors[k];
+	if (!region.IsInside(N))
+	  {
+	  border = true;
+	  continue;
+	  }
+	const unsigned long off = image->ComputeOffset(N);
+	if (((image->GetPixel(N) != 0) == foreground) && !seen[off])
+	  {
+	  seen[off] = true;
+	  stack.push_back(N);
+	  }
+	}
+      }
+    if (!foreground && border)
+      {
+      if (outside) continue;
+      outside = true;
+      }
+    ++count;
+    }
+  if (!foreground && !outside)
+    {
+    // only the background around the image
+    ++count;
+    }
+  return count;
+}
+
+template <class TImage>
+unsigned long countForeground(const TImage *image)
+{
+  unsigned long count = 0;
+  itk::ImageRegionConstIterator<TImage> it(image, image->GetLargestPossibleRegion());
+  for (; !it.IsAtEnd(); ++it)
+    {
+    count += (it.Get() != 0);
+    }
+  return count;
+}
+
+// a region of image, as an image of its own
+template <class TImage>
+typename TImage::Pointer crop(const TImage *image, const typename TImage::RegionType &region)
+{
+  typename TImage::Pointer result = TImage::New();
+  result->SetRegions(region);
+  result->SetSpacing(image->GetSpacing());
+  result->Allocate();
+  itk::ImageRegionConstIterator<TImage> iIt(image, region);
+  itk::ImageRegionIterator<TImage> rIt(result, region);
+  for (; !rIt.IsAtEnd(); ++iIt, ++rIt)
+    {
+    rIt.Set(iIt.Get());
+    }
+  return result;
+}
+
+template <class TSkel>
+int batchTest(const typename TSkel::OrderingImageType *ordering)
+{
+  typedef typename TSkel::OrderingImageType DistType;
+  typedef typename TSkel::OutputImageType IType;
+  const unsigned dim = DistType::ImageDimension;
+
+  typename TSkel::Pointer batch = TSkel::New();
+  typename IType::Pointer out = IType::New();
+  const typename DistType::RegionType whole = ordering->GetLargestPossibleRegion();
+  for (unsigned k = 0; k < 6; k++)
+    {
+    // a half, three quarters or the whole of each dimension, shrinking
+    // and growing again
+    typename DistType::RegionType region = whole;
+    for (unsigned d = 0; d < dim; d++)
+      {
+      const unsigned long size = whole.GetSize()[d] * (2 + (k + d) % 3) / 4;
+      region.SetSize(d, size);
+      region.SetIndex(d, whole.GetIndex()[d] + (whole.GetSize()[d] - size) / 2);
+      }
+    typename DistType::Pointer part = crop<DistType>(ordering, region);
+
+    // the last crops go through the quantized thinning
+    typename TSkel::Pointer fresh = TSkel::New();
+    fresh->SetQuantizeOrdering(k >= 3);
+    batch->SetQuantizeOrdering(k >= 3);
+    fresh->SetInput(part);
+    fresh->Update();
+    batch->ProcessImage(part, out);
+
+    if (out->GetLargestPossibleRegion() != region)
+      {
+      std::cerr << "crop " << k << ": wrong output region" << std::endl;
+      return EXIT_FAILURE;
+      }
+    itk::ImageRegionConstIterator<IType> fIt(fresh->GetOutput(), region);
+    itk::ImageRegionConstIterator<IType> bIt(out, region);
+    for (; !fIt.IsAtEnd(); ++fIt, ++bIt)
+      {
+      if (fIt.Get() != bIt.Get())
+	{
+	std::cerr << "crop " << k << ": the skeletons differ" << std::endl;
+	return EXIT_FAILURE;
+	}
+      }
+    if (batch->GetNumberOfQueuePushes() != fresh->GetNumberOfQueuePushes())
+      {
+      std::cerr << "crop " << k << ": the queue pushes differ" << std::endl;
+      return EXIT_FAILURE;
+      }
+    if (batch->GetInput() != 0 ||
+	batch->GetOutput()->GetBufferPointer() == out->GetBufferPointer())
+      {
+      std::cerr << "crop " << k << ": the filter holds on to the images" << std::endl;
+      return EXIT_FAILURE;
+      }
+    std::cout << "crop " << k << ": " << region.GetSize() << ", "
+	      << countForeground(out.GetPointer()) << " voxels" << std::endl;
+    }
+  batch->ReleaseWorkingMemory();
+  return EXIT_SUCCESS;
+}
+
+// the input is a 2D image. In 3D it is stacked: slice z is the image
+// shifted by z voxels along x, so that the objects lean rather than
+// being plain extrusions
+template <class TImage>
+typename TImage::Pointer readInput(const std::string &inputName)
+{
+  typedef itk::Image< typename TImage::PixelType, 2 > SliceType;
+  const unsigned long depth = 12;
+
+  typename SliceType::Pointer slice = readIm<SliceType>(inputName);
+  const typename SliceType::RegionType sliceRegion = slice->GetLargestPossibleRegion();
+
+  typename TImage::SizeType size;
+  size.Fill(depth);
+  size[0] = sliceRegion.GetSize()[0];
+  size[1] = sliceRegion.GetSize()[1];
+  typename TImage::RegionType region;
+  region.SetSize(size);
+
+  typename TImage::Pointer input = TImage::New();
+  input->SetRegions(region);
+  input->Allocate();
+  itk::ImageRegionIteratorWithIndex<TImage> it(input, region);
+  for (it.GoToBegin(); !it.IsAtEnd(); ++it)
+    {
+    typename SliceType::IndexType pos;
+    pos[0] = it.GetIndex()[0];
+    pos[1] = it.GetIndex()[1];
+    for (unsigned d = 2; d < TImage::ImageDimension; d++)
+      {
+      pos[0] -= it.GetIndex()[d];
+      }
+    pos[0] += sliceRegion.GetIndex()[0];
+    pos[1] += sliceRegion.GetIndex()[1];
+    it.Set(sliceRegion.IsInside(pos) ? slice->GetPixel(pos) : 0);
+    }
+  return input;
+}
+
+template <unsigned dim>
+int modeTest(const std::string &mode, const std::string &inputName)
+{
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+  typedef itk::Image< float, dim > DistType;
+
+  typename IType::Pointer input = readInput<IType>(inputName);
+
+  typedef itk::BinaryThresholdImageFilter<IType, IType> ThreshType;
+  typedef itk::DanielssonDistanceMapImageFilter<IType, DistType> DTType;
+
+  // the distance to the background inside the objects, as in skelTest
+  typename ThreshType::Pointer thresh = ThreshType::New();
+  thresh->SetInput(input);
+  thresh->SetUpperThreshold(130);
+  thresh->SetOutsideValue(0);
+  thresh->SetInsideValue(1);
+
+  typename DTType::Pointer dt = DTType::New();
+  dt->SetInput(thresh->GetOutput());
+  dt->Update();
+
+  typedef itk::SkeletonizeBaseImageFilter<DistType, IType> SkelType;
+
+  // one voxel in 50 of those being thinned, in raster order
+  typename IType::Pointer anchors = IType::New();
+  anchors->SetRegions(input->GetLargestPossibleRegion());
+  anchors->Allocate();
+  anchors->FillBuffer(0);
+  unsigned long anchorCount = 0;
+  itk::ImageRegionConstIterator<DistType> mIt(dt->GetOutput(), anchors->GetLargestPossibleRegion());
+  itk::ImageRegionIterator<IType> aIt(anchors, anchors->GetLargestPossibleRegion());
+  for (unsigned long k = 0; !mIt.IsAtEnd(); ++mIt, ++aIt)
+    {
+    if (mIt.Get() != 0 && (k++ % 50) == 0)
+      {
+      aIt.Set(1);
+      ++anchorCount;
+      }
+    }
+
+  const unsigned fgConnectivity = 0;
+  const unsigned bgConnectivity = dim - 1;
+
+  if (mode == "batch")
+    {
+    return batchTest<SkelType>(dt->GetOutput());
+    }
+
+  typename SkelType::Pointer serial = SkelType::New();
+  serial->SetForegroundCellConnectivity(fgConnectivity);
+  serial->SetBackgroundCellConnectivity(bgConnectivity);
+  serial->SetInput(dt->GetOutput());
+  serial->Update();
+
+  typename SkelType::Pointer tested = SkelType::New();
+  tested->SetForegroundCellConnectivity(fgConnectivity);
+  tested->SetBackgroundCellConnectivity(bgConnectivity);
+  tested->SetNumberOfThreads(4);
+  tested->SetInput(dt->GetOutput());
+  bool identical = false;
+  if (mode == "components")
+    {
+    tested->SetParallelComponentThinning(true);
+    identical = true;
+    }
+  else if (mode == "subfields")
+    {
+    tested->SetParallelThinning(true);
+    }
+  else if (mode == "quantize")
+    {
+    tested->SetQuantizeOrdering(true);
+    }
+  else if (mode == "anchors")
+    {
+    tested->SetAnchorImage(anchors);
+    }
+  else
+    {
+    std::cerr << "unknown mode " << mode << std::endl;
+    return EXIT_FAILURE;
+    }
+  tested->Update();
+
+  const IType *reference = serial->GetOutput();
+  const IType *skeleton = tested->GetOutput();
+  std::cout << mode << ": serial " << countForeground(reference)
+	    << " voxels, " << mode << " " << countForeground(skeleton) << std::endl;
+
+  if (identical)
+    {
+    itk::ImageRegionConstIterator<IType> rIt(reference, reference->GetLargestPossibleRegion());
+    itk::ImageRegionConstIterator<IType> sIt(skeleton, skeleton->GetLargestPossibleRegion());
+    for (; !rIt.IsAtEnd(); ++rIt, ++sIt)
+      {
+      if (rIt.Get() != sIt.Get())
+	{
+	std::cerr << "the skeletons differ" << std::endl;
+	return EXIT_FAILURE;
+	}
+      }
+    return EXIT_SUCCESS;
+    }
+
+  if (mode == "anchors")
+    {
+    unsigned long kept = 0;
+    itk::ImageRegionConstIterator<IType> sIt(skeleton, skeleton->GetLargestPossibleRegion());
+    for (aIt.GoToBegin(); !aIt.IsAtEnd(); ++aIt, ++sIt)
+      {
+      kept += (aIt.Get() != 0 && sIt.Get() != 0);
+      }
+    std::cout << "anchors " << anchorCount << ", kept " << kept << std::endl;
+    if (kept != anchorCount)
+      {
+      std::cerr << "anchors were removed" << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    // an anchor image that doesn't cover the ordering image
+    typename IType::RegionType smaller = anchors->GetLargestPossibleRegion();
+    typename IType::SizeType size = smaller.GetSize();
+    size[0] /= 2;
+    smaller.SetSize(size);
+    typename IType::Pointer half = IType::New();
+    half->SetRegions(smaller);
+    half->Allocate();
+    half->FillBuffer(0);
+    typename SkelType::Pointer refused = SkelType::New();
+    refused->SetInput(dt->GetOutput());
+    refused->SetAnchorImage(half);
+    try
+      {
+      refused->Update();
+      std::cerr << "a smaller anchor image was accepted" << std::endl;
+      return EXIT_FAILURE;
+      }
+    catch (itk::ExceptionObject &)
+      {
+      }
+    }
+
+  // same topology as the serial skeleton
+  const unsigned long refFG = countComponents(reference, true, fgConnectivity);
+  const unsigned long refBG = countComponents(reference, false, bgConnectivity);
+  const unsigned long skelFG = countComponents(skeleton, true, fgConnectivity);
+  const unsigned long skelBG = countComponents(skeleton, false, bgConnectivity);
+  std::cout << "foreground/background components: serial " << refFG << "/" << refBG
+	    << ", " << mode << " " << skelFG << "/" << skelBG << std::endl;
+  if ((refFG != skelFG) || (refBG != skelBG))
+    {
+    std::cerr << "the topologies differ" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // and thin: thinning the skeleton again removes nothing
+  typename DistType::Pointer ordering = DistType::New();
+  ordering->SetRegions(skeleton->GetLargestPossibleRegion());
+  ordering->Allocate();
+  itk::ImageRegionConstIterator<IType> sIt(skeleton, skeleton->GetLargestPossibleRegion());
+  itk::ImageRegionIterator<DistType> oIt(ordering, ordering->GetLargestPossibleRegion());
+  for (; !sIt.IsAtEnd(); ++sIt, ++oIt)
+    {
+    oIt.Set(sIt.Get() != 0);
+    }
+  typename SkelType::Pointer again = SkelType::New();
+  again->SetForegroundCellConnectivity(fgConnectivity);
+  again->SetBackgroundCellConnectivity(bgConnectivity);
+  again->SetInput(ordering);
+  if (mode == "anchors")
+    {
+    again->SetAnchorImage(anchors);
+    }
+  again->Update();
+  if (countForeground(again->GetOutput()) != countForeground(skeleton))
+    {
+    std::cerr << "the skeleton isn't thin" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char * argv[])
+{
+
+  if( argc != 4 )
+    {
+    std::cerr << "usage: " << argv[0] << " dim mode input" << std::endl;
+    std::cerr << " dim: 2 or 3, the dimension of the test" << std::endl;
+    std::cerr << " mode: components, subfields, quantize, anchors or batch" << std::endl;
+    std::cerr << " input: a 2D image, stacked in 3D" << std::endl;
+    exit(1);
+    }
+
+  const int dim = atoi(argv[1]);
+  if (dim == 2)
+    {
+    return modeTest<2>(argv[2], argv[3]);
+    }
+  if (dim == 3)
+    {
+    return modeTest<3>(argv[2], argv[3]);
+    }
+  std::cerr << "unsupported dimension " << dim << std::endl;
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#include "ioutils.h"
+#include "itkSliceSkeletonizeImageFilter.h"
+#include "itkSkeletonizeImageFilter.h"
+#include "itkExtractImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+
+// skeletonizes the slices of a stack with SliceSkeletonizeImageFilter,
+// and checks the result against extracting each slice, skeletonizing
+// it with SkeletonizeImageFilter and the SeparableEuclidean distance,
+// and pasting it back. The stack is built from a 2D image, thresholded
+// at a different level in each slice, with a spacing that differs
+// between the dimensions. Slices normal to the last dimension are
+// thinned in place, the others through the strided copy.
+
+int main(int argc, char * argv[])
+{
+
+  if( argc != 4 )
+    {
+    std::cerr << "usage: " << argv[0] << " intput output direction" << std::endl;
+    std::cerr << " input: a 2D image, stacked and thresholded" << std::endl;
+    std::cerr << " output: the output image" << std::endl;
+    std::cerr << " direction: the dimension normal to the slices" << std::endl;
+    exit(1);
+    }
+
+  const int dim = 3;
+
+  typedef unsigned char PType;
+  typedef itk::Image< PType, dim > IType;
+  typedef itk::Image< PType, dim - 1 > SliceType;
+
+  // large images are mapped rather than read when the file allows it
+  SliceType::Pointer input = mapIm<SliceType>(argv[1]);
+  const unsigned direction = atoi(argv[3]);
+  if (direction >= dim)
+    {
+    std::cerr << "direction must be less than " << dim << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // slice z of the stack is the image above 70 + 15 * z
+  const unsigned long depth = 9;
+  IType::SizeType size;
+  size[0] = input->GetLargestPossibleRegion().GetSize()[0];
+  size[1] = input->GetLargestPossibleRegion().GetSize()[1];
+  size[2] = depth;
+  IType::IndexType start;
+  start.Fill(0);
+  IType::RegionType region;
+  region.SetSize(size);
+  region.SetIndex(start);
+  IType::SpacingType spacing;
+  spacing[0] = 1.0;
+  spacing[1] = 1.25;
+  spacing[2] = 2.0;
+
+  IType::Pointer stack = IType::New();
+  stack->SetRegions(region);
+  stack->SetSpacing(spacing);
+  stack->Allocate();
+  itk::ImageRegionIteratorWithIndex<IType> st(stack, region);
+  for (st.GoToBegin(); !st.IsAtEnd(); ++st)
+    {
+    const IType::IndexType idx = st.GetIndex();
+    SliceType::IndexType pos;
+    pos[0] = idx[0] + input->GetLargestPossibleRegion().GetIndex()[0];
+    pos[1] = idx[1] + input->GetLargestPossibleRegion().GetIndex()[1];
+    st.Set(input->GetPixel(pos) > 70 + 15 * idx[2] ? 1 : 0);
+    }
+
+  // a 2D skeleton of each slice of the stack
+  typedef itk::SliceSkeletonizeImageFilter<IType> SkelType;
+
+  SkelType::Pointer skel = SkelType::New();
+  skel->SetSliceDirection(direction);
+  skel->SetInput(stack);
+  skel->Update();
+  writeIm<IType>(skel->GetOutput(), argv[2]);
+
+  // the same, one slice at a time
+  typedef itk::ExtractImageFilter<IType, SliceType> ExtractType;
+  typedef itk::SkeletonizeImageFilter<SliceType> SliceSkelType;
+
+  IType::Pointer expected = IType::New();
+  expected->SetRegions(region);
+  expected->SetSpacing(spacing);
+  expected->Allocate();
+  for (unsigned long s = 0; s < size[direction]; s++)
+    {
+    IType::RegionType sliceRegion = region;
+    sliceRegion.SetIndex(direction, s);
+    sliceRegion.SetSize(direction, 0);
+
+    ExtractType::Pointer extract = ExtractType::New();
+    extract->SetInput(stack);
+    extract->SetExtractionRegion(sliceRegion);
+
+    SliceSkelType::Pointer sliceSkel = SliceSkelType::New();
+    sliceSkel->SetInput(extract->GetOutput());
+    sliceSkel->SetDistanceTransform(SliceSkelType::SeparableEuclidean);
+    sliceSkel->Update();
+
+    // the extracted slice keeps the order of the other dimensions
+    sliceRegion.SetSize(direction, 1);
+    itk::ImageRegionConstIterator<SliceType> it(sliceSkel->GetOutput(),
+					       sliceSkel->GetOutput()->GetLargestPossibleRegion());
+    itk::ImageRegionIterator<IType> ot(expected, sliceRegion);
+    for (it.GoToBegin(), ot.GoToBegin(); !ot.IsAtEnd(); ++it, ++ot)
+      {
+      ot.Set(it.Get());
+      }
+    }
+
+  unsigned long differences = 0, foreground = 0;
+  itk::ImageRegionConstIterator<IType> et(expected, region);
+  itk::ImageRegionConstIterator<IType> kt(skel->GetOutput(), region);
+  for (et.GoToBegin(), kt.GoToBegin(); !et.IsAtEnd(); ++et, ++kt)
+    {
+    differences += (et.Get() != kt.Get());
+    foreground += (et.Get() != 0);
+    }
+  std::cout << "direction " << direction << ": " << foreground
+	    << " skeleton voxels, " << differences << " differ" << std::endl;
+  if (differences || !foreground)
+    {
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
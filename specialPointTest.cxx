@@ -1,6 +1,7 @@
 #include "ioutils.h"
 #include "itkSkeletonizeImageFilter.h"
 #include "itkSpecialSkeletonPointsImageFilter.h"
+#include "itkImageRegionConstIterator.h"
 
 
 int main(int argc, char * argv[])
@@ -55,9 +56,54 @@ int main(int argc, char * argv[])
   writeIm<IType>(skel->GetOutput(), argv[2]);
   writeIm<IType>(branches->GetOutput(), argv[3]);
 
-  branches->SetEndPoints(false);
-  branches->Modified();
-  writeIm<IType>(branches->GetOutput(), argv[4]);
+  BranchType::Pointer branches2 = BranchType::New();
+  branches2->SetInput(skel->GetOutput());
+  branches2->SetForegroundCellConnectivity(0);
+  branches2->SetEndPoints(false);
+  writeIm<IType>(branches2->GetOutput(), argv[4]);
+
+  // label the end and branch points in one run, which must mark the
+  // same points
+  BranchType::Pointer labels = BranchType::New();
+  labels->SetInput(skel->GetOutput());
+  labels->SetForegroundCellConnectivity(0);
+  labels->SetLabelPoints(true);
+
+  ThreshType::Pointer endPoints = ThreshType::New();
+  endPoints->SetInput(labels->GetOutput());
+  endPoints->SetLowerThreshold(BranchType::EndPoint);
+  endPoints->SetUpperThreshold(BranchType::EndPoint);
+  endPoints->SetInsideValue(1);
+  endPoints->SetOutsideValue(0);
+  endPoints->Update();
+
+  ThreshType::Pointer branchPoints = ThreshType::New();
+  branchPoints->SetInput(labels->GetOutput());
+  branchPoints->SetLowerThreshold(BranchType::BranchPoint);
+  branchPoints->SetUpperThreshold(BranchType::BranchPoint);
+  branchPoints->SetInsideValue(1);
+  branchPoints->SetOutsideValue(0);
+  branchPoints->Update();
+
+  const IType::RegionType region = skel->GetOutput()->GetLargestPossibleRegion();
+  itk::ImageRegionConstIterator<IType> eIt(branches->GetOutput(), region);
+  itk::ImageRegionConstIterator<IType> bIt(branches2->GetOutput(), region);
+  itk::ImageRegionConstIterator<IType> leIt(endPoints->GetOutput(), region);
+  itk::ImageRegionConstIterator<IType> lbIt(branchPoints->GetOutput(), region);
+  unsigned long ends = 0, junctions = 0, differences = 0;
+  for (; !eIt.IsAtEnd(); ++eIt, ++bIt, ++leIt, ++lbIt)
+    {
+    ends += (eIt.Get() != 0);
+    junctions += (bIt.Get() != 0);
+    differences += ((eIt.Get() != 0) != (leIt.Get() != 0));
+    differences += ((bIt.Get() != 0) != (lbIt.Get() != 0));
+    }
+  std::cout << ends << " end points, " << junctions << " branch points, "
+	    << differences << " labelled differently" << std::endl;
+  if (differences)
+    {
+    return EXIT_FAILURE;
+    }
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,96 @@
+#include "ioutils.h"
+#include "itkSpurPruningImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+
+// prunes a synthetic skeleton first: a Y whose short arm must go and
+// a short bare segment, which isn't a spur, must stay. Then prunes
+// the given image.
+
+typedef unsigned char PType;
+typedef itk::Image< PType, 2 > IType;
+typedef itk::SpurPruningImageFilter<IType, IType> PruneType;
+
+static void drawLine(IType *image, long x, long y, long dx, long dy, unsigned long steps)
+{
+  for (unsigned long i = 0; i < steps; i++, x += dx, y += dy)
+    {
+    IType::IndexType idx;
+    idx[0] = x;
+    idx[1] = y;
+    image->SetPixel(idx, 1);
+    }
+}
+
+static bool checkSynthetic()
+{
+  IType::SizeType size;
+  size.Fill(64);
+  IType::RegionType region;
+  region.SetSize(size);
+
+  IType::Pointer skel = IType::New();
+  skel->SetRegions(region);
+  skel->Allocate();
+  skel->FillBuffer(0);
+  IType::Pointer expected = IType::New();
+  expected->SetRegions(region);
+  expected->Allocate();
+  expected->FillBuffer(0);
+
+  // stem from (20, 10) to the branch point at (20, 40), a long arm
+  // down and to the right, a short one down and to the left
+  drawLine(skel, 20, 10, 0, 1, 31);
+  drawLine(skel, 21, 41, 1, 1, 15);
+  drawLine(skel, 19, 41, -1, 1, 3);
+  // a bare segment of 4 voxel lengths
+  drawLine(skel, 40, 55, 1, 0, 5);
+
+  drawLine(expected, 20, 10, 0, 1, 31);
+  drawLine(expected, 21, 41, 1, 1, 15);
+  drawLine(expected, 40, 55, 1, 0, 5);
+
+  PruneType::Pointer pruner = PruneType::New();
+  pruner->SetInput(skel);
+  pruner->SetMaximumSpurLength(10);
+  pruner->SetRepeatUntilStable(true);
+  pruner->Update();
+
+  unsigned long differences = 0;
+  itk::ImageRegionConstIterator<IType> et(expected, region);
+  itk::ImageRegionConstIterator<IType> ot(pruner->GetOutput(), region);
+  for (et.GoToBegin(), ot.GoToBegin(); !et.IsAtEnd(); ++et, ++ot)
+    {
+    differences += ((et.Get() != 0) != (ot.Get() != 0));
+    }
+  std::cout << "Synthetic: removed " << pruner->GetNumberOfRemovedVoxels()
+	    << " voxels, " << differences << " differ" << std::endl;
+  return (differences == 0 && pruner->GetNumberOfRemovedVoxels() == 3);
+}
+
+int main(int argc, char * argv[])
+{
+
+  if( argc != 4 )
+    {
+    std::cerr << "usage: " << argv[0] << " length intput output" << std::endl;
+    std::cerr << " length: the longest spur removed" << std::endl;
+    std::cerr << " input: the input image" << std::endl;
+    std::cerr << " output: the output image" << std::endl;
+    exit(1);
+    }
+
+  if (!checkSynthetic())
+    {
+    return EXIT_FAILURE;
+    }
+
+  IType::Pointer input = readIm<IType>(argv[2]);
+
+  PruneType::Pointer pruner = PruneType::New();
+  pruner->SetInput(input);
+  pruner->SetMaximumSpurLength(atof(argv[1]));
+  pruner->SetRepeatUntilStable(true);
+  writeIm<IType>(pruner->GetOutput(), argv[3]);
+  std::cout << "Removed " << pruner->GetNumberOfRemovedVoxels() << " voxels" << std::endl;
+  return EXIT_SUCCESS;
+}